@@ -7,7 +7,18 @@
  * See the LICENSE file for redistribution information.
  */
 
+/*
+ * The record numbers of db(3) are 32 bits, the editor's line numbers are
+ * 64 bits, so files aren't limited to 2^32 lines.  The db(3) recno_t is
+ * renamed db_recno_t, and is only used to talk to db(3).
+ */
+#define	recno_t	db_recno_t
 #include "/usr/include/db.h"	/* Only include db1. */
+#undef	recno_t
+typedef u_int64_t	recno_t;	/* Line number. */
+#undef	MAX_REC_NUMBER
+#define	MAX_REC_NUMBER		((recno_t)-1)	/* Last line number. */
+#define	DB_MAX_REC_NUMBER	((db_recno_t)-1)	/* Last db(3) record. */
 #include <regex.h>		/* May refer to the bundled regex. */
 
 /*
@@ -23,11 +34,16 @@ typedef struct _excmd		EXCMD;
 typedef struct _exf		EXF;
 typedef struct _fref		FREF;
 typedef struct _gs		GS;
+typedef struct _lcache		LCACHE;
 typedef struct _lmark		LMARK;
+typedef struct _loghdr		LOGHDR;
+typedef struct _logseg		LOGSEG;
+typedef struct _lstore		LSTORE;
 typedef struct _mark		MARK;
 typedef struct _msg		MSGS;
 typedef struct _option		OPTION;
 typedef struct _optlist		OPTLIST;
+typedef struct _recache		RECACHE;
 typedef struct _scr		SCR;
 typedef struct _script		SCRIPT;
 typedef struct _seq		SEQ;
@@ -79,6 +95,7 @@ typedef enum { SEQ_ABBREV, SEQ_COMMAND, SEQ_INPUT } seq_t;
 #include "../ex/ex.h"		/* Required by gs.h. */
 #include "gs.h"			/* Required by screen.h. */
 #include "screen.h"		/* Required by exf.h. */
+#include "lstore.h"		/* Required by exf.h. */
 #include "exf.h"
 #include "log.h"
 #include "mem.h"
@@ -26,6 +26,10 @@
 #include <strings.h>
 #include <unistd.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "common.h"
 
 /*
@@ -65,6 +69,100 @@ raw2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw, size_t *tolen,
 	return 0;
 }
 
+/*
+ * In the encodings for which ascii_compat() is true, a 7-bit byte is the
+ * ASCII character and nothing else, in both the file and the locale, and
+ * its wide character value is its byte value.  Lines of 7-bit characters
+ * don't need iconv(3) or the multibyte functions, they're widened and
+ * narrowed in place, a vector at a time where the compiler targets it.
+ * The lines are checked as they're converted, they fall back to the full
+ * conversion at the first 8-bit character.
+ */
+static int
+ascii_compat(const char *enc)
+{
+	return (!strcasecmp(enc, "UTF-8") || !strcasecmp(enc, "UTF8") ||
+	    !strcasecmp(enc, "US-ASCII") || !strcasecmp(enc, "ASCII") ||
+	    !strcasecmp(enc, "ANSI_X3.4-1968") ||
+	    !strncasecmp(enc, "ISO-8859-", 9) ||
+	    !strncasecmp(enc, "ISO8859-", 8));
+}
+
+/*
+ * ascii_widen --
+ *	Widen the leading 7-bit characters of str into dst, returning the
+ *	number widened.
+ */
+static size_t
+ascii_widen(const char *str, size_t len, CHAR_T *dst)
+{
+	size_t i;
+
+	i = 0;
+#if defined(__SSE2__) && __SIZEOF_WCHAR_T__ == 4
+	{
+		__m128i lo, hi, v, z;
+
+		z = _mm_setzero_si128();
+		for (; len - i >= 16; i += 16) {
+			v = _mm_loadu_si128((const __m128i *)(str + i));
+			if (_mm_movemask_epi8(v) != 0)
+				break;
+			lo = _mm_unpacklo_epi8(v, z);
+			hi = _mm_unpackhi_epi8(v, z);
+			_mm_storeu_si128((__m128i *)(dst + i),
+			    _mm_unpacklo_epi16(lo, z));
+			_mm_storeu_si128((__m128i *)(dst + i + 4),
+			    _mm_unpackhi_epi16(lo, z));
+			_mm_storeu_si128((__m128i *)(dst + i + 8),
+			    _mm_unpacklo_epi16(hi, z));
+			_mm_storeu_si128((__m128i *)(dst + i + 12),
+			    _mm_unpackhi_epi16(hi, z));
+		}
+	}
+#endif
+	for (; i < len && (u_char)str[i] < 0x80; ++i)
+		dst[i] = str[i];
+	return (i);
+}
+
+/*
+ * ascii_narrow --
+ *	Narrow the leading 7-bit characters of str into dst, returning the
+ *	number narrowed.
+ */
+static size_t
+ascii_narrow(const CHAR_T *str, size_t len, char *dst)
+{
+	size_t i;
+
+	i = 0;
+#if defined(__SSE2__) && __SIZEOF_WCHAR_T__ == 4
+	{
+		__m128i a, b, c, d, m, z;
+
+		m = _mm_set1_epi32(~0x7f);
+		z = _mm_setzero_si128();
+		for (; len - i >= 16; i += 16) {
+			a = _mm_loadu_si128((const __m128i *)(str + i));
+			b = _mm_loadu_si128((const __m128i *)(str + i + 4));
+			c = _mm_loadu_si128((const __m128i *)(str + i + 8));
+			d = _mm_loadu_si128((const __m128i *)(str + i + 12));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(
+			    _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d)),
+			    m), z)) != 0xffff)
+				break;
+			_mm_storeu_si128((__m128i *)(dst + i),
+			    _mm_packus_epi16(_mm_packs_epi32(a, b),
+			    _mm_packs_epi32(c, d)));
+		}
+	}
+#endif
+	for (; i < len && (u_int)str[i] < 0x80; ++i)
+		dst[i] = str[i];
+	return (i);
+}
+
 #define CONV_BUFFER_SIZE    512
 /* fill the buffer with codeset encoding of string pointed to by str
  * left has the number of bytes left in str and is adjusted
@@ -99,7 +197,7 @@ raw2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw, size_t *tolen,
 
 static int 
 default_char2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw, 
-    size_t *tolen, CHAR_T **dst, iconv_t id)
+    size_t *tolen, CHAR_T **dst, iconv_t id, int ascii)
 {
 	size_t i = 0, j;
 	CHAR_T **tostr = &cw->bp1.wc;
@@ -117,6 +215,12 @@ default_char2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw,
 	memset(&mbs, 0, sizeof(mbs));
 	BINC_RETW(NULL, *tostr, *blen, nlen);
 
+	if (ascii && ascii_widen(str, len, *tostr) == (size_t)len) {
+		*tolen = len;
+		*dst = cw->bp1.wc;
+		return 0;
+	}
+
 #ifdef USE_ICONV
 	if (id != (iconv_t)-1)
 		CONVERT(str, left, src, len);
@@ -156,7 +260,7 @@ fe_char2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw, size_t *tolen,
     CHAR_T **dst)
 {
 	return default_char2int(sp, str, len, cw, tolen, dst,
-	    sp->conv.id[IC_FE_CHAR2INT]);
+	    sp->conv.id[IC_FE_CHAR2INT], F_ISSET(&sp->conv, CONV_FE_ASCII));
 }
 
 static int 
@@ -164,14 +268,15 @@ ie_char2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw, size_t *tolen,
     CHAR_T **dst)
 {
 	return default_char2int(sp, str, len, cw, tolen, dst,
-	    sp->conv.id[IC_IE_CHAR2INT]);
+	    sp->conv.id[IC_IE_CHAR2INT], 0);
 }
 
 static int 
 cs_char2int(SCR *sp, const char * str, ssize_t len, CONVWIN *cw, size_t *tolen,
     CHAR_T **dst)
 {
-	return default_char2int(sp, str, len, cw, tolen, dst, (iconv_t)-1);
+	return default_char2int(sp, str, len, cw, tolen, dst,
+	    (iconv_t)-1, F_ISSET(&sp->conv, CONV_CS_ASCII));
 }
 
 static int 
@@ -195,7 +300,7 @@ int2raw(SCR *sp, const CHAR_T * str, ssize_t len, CONVWIN *cw, size_t *tolen,
 
 static int 
 default_int2char(SCR *sp, const CHAR_T * str, ssize_t len, CONVWIN *cw, 
-    size_t *tolen, char **pdst, iconv_t id)
+    size_t *tolen, char **pdst, iconv_t id, int ascii)
 {
 	size_t i, j, offset = 0;
 	char **tostr = &cw->bp1.c;
@@ -245,6 +350,13 @@ default_int2char(SCR *sp, const CHAR_T * str, ssize_t len, CONVWIN *cw,
 	BINC_RETC(NULL, *tostr, *blen, nlen);
 	dst = *tostr; buflen = *blen;
 
+	if (ascii && ascii_narrow(str, len, dst) == (size_t)len) {
+		dst[len] = '\0';
+		*tolen = len;
+		*pdst = cw->bp1.c;
+		return 0;
+	}
+
 #ifdef USE_ICONV
 	if (id != (iconv_t)-1) {
 		dst = buffer; buflen = CONV_BUFFER_SIZE;
@@ -293,14 +405,15 @@ fe_int2char(SCR *sp, const CHAR_T * str, ssize_t len, CONVWIN *cw,
     size_t *tolen, char **dst)
 {
 	return default_int2char(sp, str, len, cw, tolen, dst,
-		sp->conv.id[IC_FE_INT2CHAR]);
+		sp->conv.id[IC_FE_INT2CHAR], F_ISSET(&sp->conv, CONV_FE_ASCII));
 }
 
 static int 
 cs_int2char(SCR *sp, const CHAR_T * str, ssize_t len, CONVWIN *cw, 
     size_t *tolen, char **dst)
 {
-	return default_int2char(sp, str, len, cw, tolen, dst, (iconv_t)-1);
+	return default_int2char(sp, str, len, cw, tolen, dst,
+		(iconv_t)-1, F_ISSET(&sp->conv, CONV_CS_ASCII));
 }
 
 #endif
@@ -349,6 +462,9 @@ conv_init(SCR *orig, SCR *sp)
 			sp->conv.file2int = fe_char2int;
 			sp->conv.int2file = fe_int2char;
 			sp->conv.input2int = ie_char2int;
+			if (ascii_compat(codeset()))
+				F_SET(&sp->conv,
+				    CONV_CS_ASCII | CONV_FE_ASCII);
 		}
 #ifdef USE_ICONV
 		o_set(sp, O_INPUTENCODING, OS_STRDUP, codeset(), 0);
@@ -396,6 +512,9 @@ conv_enc(SCR *sp, int option, char *enc)
 			id_w2c = (iconv_t)-1;
 		}
 
+		F_CLR(&sp->conv, CONV_FE_ASCII);
+		if (F_ISSET(&sp->conv, CONV_CS_ASCII) && ascii_compat(enc))
+			F_SET(&sp->conv, CONV_FE_ASCII);
 		break;
 
 	case O_INPUTENCODING:
@@ -446,6 +565,25 @@ err:
 	return 1;
 }
 
+/*
+ * conv_mtsafe --
+ *	Return if the file encoding conversion may be used by more than one
+ *	thread at a time, each with its own buffer.  An iconv(3) descriptor
+ *	can only be used by one.
+ *
+ * PUBLIC: int conv_mtsafe(SCR *);
+ */
+int
+conv_mtsafe(SCR *sp)
+{
+#if defined(USE_WIDECHAR) && defined(USE_ICONV)
+	return (sp->conv.file2int != fe_char2int ||
+	    sp->conv.id[IC_FE_CHAR2INT] == (iconv_t)-1);
+#else
+	return (1);
+#endif
+}
+
 /*
  * conv_end --
  *	Close the iconv descriptors, release the buffer.
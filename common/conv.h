@@ -52,4 +52,8 @@ struct _conv {
 	wchar2char_t	int2file;
 	char2wchar_t	input2int;
 	iconv_t		id[IC_IE_TO_UTF16 + 1];
+
+#define	CONV_CS_ASCII	0x01	/* Locale keeps 7-bit characters. */
+#define	CONV_FE_ASCII	0x02	/* File encoding keeps 7-bit characters. */
+	u_int8_t	flags;
 };
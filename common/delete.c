@@ -22,6 +22,8 @@
 
 #include "common.h"
 
+static int	del_lines(SCR *, recno_t, recno_t);
+
 /*
  * del --
  *	Delete a range of text.
@@ -40,13 +42,8 @@ del(SCR *sp, MARK *fm, MARK *tm, int lmode)
 
 	/* Case 1 -- delete in line mode. */
 	if (lmode) {
-		for (lno = tm->lno; lno >= fm->lno; --lno) {
-			if (db_delete(sp, lno))
-				return (1);
-			++sp->rptlines[L_DELETED];
-			if (lno % INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
-				break;
-		}
+		if (del_lines(sp, fm->lno, tm->lno))
+			return (1);
 		goto done;
 	}
 
@@ -64,14 +61,8 @@ del(SCR *sp, MARK *fm, MARK *tm, int lmode)
 		} else
 			eof = 1;
 		if (eof) {
-			for (lno = tm->lno; lno > fm->lno; --lno) {
-				if (db_delete(sp, lno))
-					return (1);
-				++sp->rptlines[L_DELETED];
-				if (lno %
-				    INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
-					break;
-			}
+			if (del_lines(sp, fm->lno + 1, tm->lno))
+				return (1);
 			if (db_get(sp, fm->lno, DBG_FATAL, &p, &len))
 				return (1);
 			GET_SPACE_RETW(sp, bp, blen, fm->cno);
@@ -140,13 +131,8 @@ del(SCR *sp, MARK *fm, MARK *tm, int lmode)
 		goto err;
 
 	/* Delete the last and intermediate lines. */
-	for (lno = tm->lno; lno > fm->lno; --lno) {
-		if (db_delete(sp, lno))
-			goto err;
-		++sp->rptlines[L_DELETED];
-		if (lno % INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
-			break;
-	}
+	if (del_lines(sp, fm->lno + 1, tm->lno))
+		goto err;
 
 done:	rval = 0;
 	if (0)
@@ -155,3 +141,24 @@ err:		rval = 1;
 		FREE_SPACEW(sp, bp, blen);
 	return (rval);
 }
+
+/*
+ * del_lines --
+ *	Delete a range of lines, last to first, in runs that end at every
+ *	INTERRUPT_CHECK'th line, stopping between runs if interrupted.
+ */
+static int
+del_lines(SCR *sp, recno_t flno, recno_t tlno)
+{
+	recno_t lno;
+
+	for (; tlno >= flno; tlno = lno - 1) {
+		lno = MAX(flno, tlno - tlno % INTERRUPT_CHECK);
+		if (db_delete_lines(sp, lno, (tlno - lno) + 1))
+			return (1);
+		sp->rptlines[L_DELETED] += (tlno - lno) + 1;
+		if (lno % INTERRUPT_CHECK == 0 && INTERRUPTED(sp))
+			break;
+	}
+	return (0);
+}
@@ -150,7 +150,7 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
 	 *	Set initial EXF flag bits.
 	 */
 	CALLOC_RET(sp, ep, 1, sizeof(EXF));
-	ep->c_lno = ep->c_nlines = OOBLNO;
+	ep->c_nlines = OOBLNO;
 	ep->rcv_fd = -1;
 	F_SET(ep, F_FIRSTMODIFY);
 
@@ -241,11 +241,19 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
 		F_SET(ep, F_MODIFIED);
 	}
 
-	/* Open a db structure. */
-	if ((ep->db = dbopen(rcv_name == NULL ? oname : NULL,
-	    O_NONBLOCK | O_RDONLY,
-	    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH,
-	    DB_RECNO, &oinfo)) == NULL) {
+	/*
+	 * Open a line store.  Recovery files written by the piece table
+	 * are plain text, not btree files, so if the recno engine can't
+	 * read the recovery file, try the piece table.
+	 */
+	if (rcv_name == NULL)
+		ep->ls = !strcmp(O_STR(sp, O_LINESTORE), LS_PIECE) ?
+		    ls_piece_open(oname, oinfo.bfname,
+		    F_ISSET(sp->gp, G_SNAPSHOT)) :
+		    ls_recno_open(oname, &oinfo);
+	else if ((ep->ls = ls_recno_open(NULL, &oinfo)) == NULL)
+		ep->ls = ls_piece_open(rcv_name, rcv_name, 1);
+	if (ep->ls == NULL) {
 		msgq_str(sp,
 		    M_SYSERR, rcv_name == NULL ? oname : rcv_name, "%s");
 		if (F_ISSET(frp, FR_NEWFILE))
@@ -313,7 +321,7 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
 	 *
 	 * XXX
 	 * While the user can't interrupt us between the open and here,
-	 * there's a race between the dbopen() and the lock.  Not much
+	 * there's a race between the open and the lock.  Not much
 	 * we can do about it.
 	 *
 	 * XXX
@@ -325,7 +333,7 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
 	 * an error.
 	 */
 	if (rcv_name == NULL)
-		switch (file_lock(sp, oname, ep->db->fd(ep->db), 0)) {
+		switch (file_lock(sp, oname, ep->ls->fd(ep->ls), 0)) {
 		case LOCK_FAILED:
 			F_SET(frp, FR_UNLOCKED);
 			break;
@@ -396,6 +404,10 @@ file_init(SCR *sp, FREF *frp, char *rcv_name, int flags)
 	sp->ep = ep;
 	sp->frp = frp;
 
+	/* Find any undo history saved for the file. */
+	if (rcv_name == NULL)
+		(void)log_open(sp);
+
 	/* Detect and set the file encoding */
 	file_encinit(sp);
 
@@ -420,8 +432,8 @@ oerr:	if (F_ISSET(ep, F_RCV_ON))
 	free(ep->rcv_path);
 	ep->rcv_path = NULL;
 
-	if (ep->db != NULL)
-		(void)ep->db->close(ep->db);
+	if (ep->ls != NULL)
+		(void)ep->ls->close(ep->ls);
 	free(ep);
 
 	return (open_err ?
@@ -534,11 +546,17 @@ file_cinit(SCR *sp)
 	 * This gets called by the file init code, because we may be in a
 	 * file of ex commands and we want to execute them from the right
 	 * location in the file.
+	 *
+	 * A line number doesn't depend on the current line, so don't wait
+	 * for the rest of a file that's still loading before moving to it.
 	 */
 	nb = 0;
 	gp = sp->gp;
 	if (gp->c_option != NULL && !F_ISSET(sp->frp, FR_NEWFILE)) {
-		if (db_last(sp, &sp->lno))
+		if (gp->c_option[strspn(gp->c_option, "0123456789")] == '\0' &&
+		    db_loading(sp, &sp->lno))
+			sp->lno = 1;
+		else if (db_last(sp, &sp->lno))
 			return;
 		if (sp->lno == 0) {
 			sp->lno = 1;
@@ -669,9 +687,9 @@ file_end(SCR *sp, EXF *ep, int force)
 	/*
 	 * Clean up the EXF structure.
 	 *
-	 * Close the db structure.
+	 * Close the line store.
 	 */
-	if (ep->db->close != NULL && ep->db->close(ep->db) && !force) {
+	if (ep->ls->close(ep->ls) && !force) {
 		msgq_str(sp, M_SYSERR, frp->name, "241|%s: close");
 		++ep->refcnt;
 		return (1);
@@ -704,8 +722,7 @@ file_end(SCR *sp, EXF *ep, int force)
 		(void)close(ep->rcv_fd);
 	free(ep->rcv_path);
 	free(ep->rcv_mpath);
-	if (ep->c_blen > 0)
-		free(ep->c_lp);
+	db_cfree(ep);
 
 	free(ep);
 	return (0);
@@ -806,6 +823,19 @@ file_write(SCR *sp, MARK *fm, MARK *tm, char *name, int flags)
 		mtype = OLDFILE;
 	}
 
+	/*
+	 * If the line store is sharing text with the file, it needs its own
+	 * copy before the file is truncated.
+	 */
+	if (mtype == OLDFILE && !LF_ISSET(FS_APPEND) &&
+	    F_ISSET(ep, F_DEVSET) &&
+	    sb.st_dev == ep->mdev && sb.st_ino == ep->minode) {
+		if (ep->ls->snapshot(ep->ls)) {
+			msgq_str(sp, M_SYSERR, name, "%s");
+			return (1);
+		}
+	}
+
 	/* Set flags to create, write, and either append or truncate. */
 	oflags = O_CREAT | O_WRONLY |
 	    (LF_ISSET(FS_APPEND) ? O_APPEND : O_TRUNC);
@@ -925,6 +955,8 @@ success_open:
 	 */
 	if (LF_ISSET(FS_ALL) && !LF_ISSET(FS_APPEND)) {
 		F_CLR(ep, F_MODIFIED);
+		if (noname)
+			(void)log_save(sp);
 		if (F_ISSET(frp, FR_TMPFILE))
 			if (noname)
 				F_SET(frp, FR_TMPEXIT);
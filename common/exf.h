@@ -7,6 +7,17 @@
  * See the LICENSE file for redistribution information.
  */
 					/* Undo direction. */
+/*
+ * lcache --
+ *	A line cache entry.
+ */
+struct _lcache {
+	CHAR_T	*lp;			/* Cached line. */
+	size_t	 len;			/* Cached line length. */
+	size_t	 blen;			/* Cached line buffer length. */
+	recno_t	 lno;			/* Cached line number. */
+};
+
 /*
  * exf --
  *	The file structure.
@@ -14,19 +25,44 @@
 struct _exf {
 	int	 refcnt;		/* Reference count. */
 
-					/* Underlying database state. */
-	DB	*db;			/* File db structure. */
-	CHAR_T	*c_lp;			/* Cached line. */
-	size_t	 c_len;			/* Cached line length. */
-	size_t	 c_blen;		/* Cached line buffer length. */
-	recno_t	 c_lno;			/* Cached line number. */
+					/* Underlying line store state. */
+	LSTORE	*ls;			/* File line store. */
+	LCACHE	*c_lines;		/* Cached lines, most recent first. */
+	size_t	 c_cnt;			/* Cached lines count. */
+	size_t	 c_size;		/* Cached lines array length. */
+	u_long	 c_hits;		/* Cached line hits. */
+	u_long	 c_misses;		/* Cached line misses. */
 	recno_t	 c_nlines;		/* Cached lines in the file. */
 
-	DB	*log;			/* Log db structure. */
+					/* Last write statistics. */
+	u_long	 w_lines;		/* Lines written. */
+	u_long	 w_bytes;		/* Bytes written. */
+	u_long	 w_calls;		/* System calls. */
+	struct timespec	 w_time;	/* Elapsed time. */
+
+	LOGSEG	*l_seg;			/* Log segments. */
+	size_t	 l_nseg;		/* Log segment count. */
+	size_t	 l_sseg;		/* Log segment array length. */
+	size_t	 l_cold;		/* Log first unspilled segment. */
+	size_t	 l_mem;			/* Log bytes in memory. */
+	int	 l_fd;			/* Log spill file descriptor. */
+	int	 l_ufd;			/* Log undo file descriptor. */
+	char	*l_upath;		/* Log undo file path. */
+	size_t	 l_ustart;		/* Log undo file start offset. */
+	LOGHDR	*l_hdr;			/* Log undo file header, if unread. */
 	char	*l_lp;			/* Log buffer. */
 	size_t	 l_len;			/* Log buffer length. */
-	recno_t	 l_high;		/* Log last + 1 record number. */
-	recno_t	 l_cur;			/* Log current record number. */
+	CHAR_T	*l_bp;			/* Log line buffer. */
+	size_t	 l_blen;		/* Log line buffer length. */
+	size_t	 l_bcnt;		/* Log line length. */
+	size_t	 l_gcnt;		/* Log line reset group length. */
+	recno_t	 l_glno;		/* Log line reset group last line. */
+	size_t	 l_base;		/* Log start offset. */
+	size_t	 l_high;		/* Log end offset. */
+	size_t	 l_cur;			/* Log current offset. */
+	size_t	 l_linit;		/* Log last change offset. */
+	u_long	 l_evicts;		/* Log evictions. */
+	u_long	 l_evbytes;		/* Log bytes evicted. */
 	MARK	 l_cursor;		/* Log cursor position. */
 	dir_t	 lundo;			/* Last undo direction. */
 
@@ -38,6 +38,19 @@ struct _fref {
 	u_int16_t flags;
 };
 
+/*
+ * Compiled RE cache entry (RECACHE).  Compiled RE's are shared by every
+ * screen, and are keyed by the converted pattern and the regcomp flags.
+ */
+struct _recache {
+	TAILQ_ENTRY(_recache) q;	/* Linked list, most recent first. */
+	CHAR_T	*ptrn;			/* Converted pattern. */
+	size_t	 plen;			/* Converted pattern length. */
+	int	 reflags;		/* Regcomp flags. */
+	regex_t	 re;			/* Compiled RE. */
+	int	 refcnt;		/* Reference count. */
+};
+
 /* Action arguments to scr_exadjust(). */
 typedef enum { EX_TERM_CE, EX_TERM_SCROLL } exadj_t;
 
@@ -75,6 +88,12 @@ struct _gs {
 #define	DEFAULT_NOPRINT	'\1'		/* Emergency non-printable character. */
 	int	 noprint;		/* Cached, unprintable character. */
 
+					/* Compiled RE cache. */
+	TAILQ_HEAD(_recacheh, _recache) recacheq[1];
+	u_long	 re_cnt;		/* Cached RE count. */
+	u_long	 re_hits;		/* Cached RE hits. */
+	u_long	 re_misses;		/* Cached RE misses. */
+
 	char	*tmp_bp;		/* Temporary buffer. */
 	size_t	 tmp_blen;		/* Temporary buffer size. */
 
@@ -17,12 +17,15 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "common.h"
 #include "../vi/vi.h"
 
-static int scr_update(SCR *, recno_t, lnop_t, int);
+static LCACHE *db_cmove(EXF *, size_t, size_t);
+static void db_cshift(EXF *, recno_t, recno_t, recno_t, long);
+static int scr_update(SCR *, recno_t, lnop_t, recno_t, int);
 
 /*
  * db_eget --
@@ -80,12 +83,13 @@ db_get(SCR *sp,
 	CHAR_T **pp,				/* Pointer store. */
 	size_t *lenp)				/* Length store. */
 {
-	DBT data, key;
 	EXF *ep;
+	LCACHE *lcp;
 	TEXT *tp;
 	recno_t l1, l2;
 	CHAR_T *wp;
-	size_t wlen;
+	size_t i, wlen, flen;
+	char *fp;
 
 	/*
 	 * The underlying recno stuff handles zero by returning NULL, but
@@ -132,23 +136,28 @@ db_get(SCR *sp,
 	}
 
 	/* Look-aside into the cache, and see if the line we want is there. */
-	if (lno == ep->c_lno) {
+	for (i = 0; i < ep->c_cnt; ++i)
+		if (ep->c_lines[i].lno == lno) {
 #if defined(DEBUG) && 0
 	TRACE(sp, "retrieve cached line %lu\n", (u_long)lno);
 #endif
-		if (lenp != NULL)
-			*lenp = ep->c_len;
-		if (pp != NULL)
-			*pp = ep->c_lp;
-		return (0);
-	}
-	ep->c_lno = OOBLNO;
+			++ep->c_hits;
+			lcp = db_cmove(ep, i, 0);
+			if (lenp != NULL)
+				*lenp = lcp->len;
+			if (pp != NULL)
+				*pp = lcp->lp;
+			return (0);
+		}
+	++ep->c_misses;
 
 nocache:
-	/* Get the line from the underlying database. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	switch (ep->db->get(ep->db, &key, &data, 0)) {
+	/* Discard any cached copy, it's replaced below. */
+	if (LF_ISSET(DBG_NOCACHE))
+		db_cshift(ep, lno, 1, OOBLNO, 0);
+
+	/* Get the line from the underlying line store. */
+	switch (ep->ls->get(ep->ls, lno, &fp, &flen)) {
 	case -1:
 		goto err2;
 	case 1:
@@ -162,22 +171,29 @@ err3:		if (lenp != NULL)
 		return (1);
 	}
 
-	if (FILE2INT(sp, data.data, data.size, wp, wlen)) {
+	if (FILE2INT(sp, fp, flen, wp, wlen)) {
 		if (!F_ISSET(sp, SC_CONV_ERROR)) {
 			F_SET(sp, SC_CONV_ERROR);
-			msgq(sp, M_ERR, "324|Conversion error on line %d", lno);
+			msgq(sp, M_ERR,
+			    "324|Conversion error on line %lu", (u_long)lno);
 		}
 		goto err3;
 	}
 
-	/* Reset the cache. */
-	if (wp != data.data) {
-		BINC_GOTOW(sp, ep->c_lp, ep->c_blen, wlen);
-		MEMCPY(ep->c_lp, wp, wlen);
-	} else
-		ep->c_lp = data.data;
-	ep->c_lno = lno;
-	ep->c_len = wlen;
+	/*
+	 * Replace the least recently used line in the cache.  The copy is
+	 * never empty, so callers are never handed a NULL line.
+	 */
+	if (ep->c_size == 0 && db_csize(sp, O_VAL(sp, O_LINECACHE)))
+		goto err3;
+	if (ep->c_cnt < ep->c_size)
+		++ep->c_cnt;
+	lcp = db_cmove(ep, ep->c_cnt - 1, 0);
+	lcp->lno = OOBLNO;
+	BINC_GOTOW(sp, lcp->lp, lcp->blen, MAX(wlen, 1));
+	MEMCPY(lcp->lp, wp, wlen);
+	lcp->lno = lno;
+	lcp->len = wlen;
 
 #if defined(DEBUG) && 0
 	TRACE(sp, "retrieve DB line %lu\n", (u_long)lno);
@@ -185,7 +201,7 @@ err3:		if (lenp != NULL)
 	if (lenp != NULL)
 		*lenp = wlen;
 	if (pp != NULL)
-		*pp = ep->c_lp;
+		*pp = lcp->lp;
 	return (0);
 }
 
@@ -198,41 +214,58 @@ err3:		if (lenp != NULL)
 int
 db_delete(SCR *sp, recno_t lno)
 {
-	DBT key;
+	return (db_delete_lines(sp, lno, 1));
+}
+
+/*
+ * db_delete_lines --
+ *	Delete cnt lines, starting at line lno, from the file.  The marks,
+ *	@ and global commands and screens are each updated once for all of
+ *	the lines.
+ *
+ * PUBLIC: int db_delete_lines(SCR *, recno_t, recno_t);
+ */
+int
+db_delete_lines(SCR *sp, recno_t lno, recno_t cnt)
+{
 	EXF *ep;
+	recno_t l;
 
 #if defined(DEBUG) && 0
-	TRACE(sp, "delete line %lu\n", (u_long)lno);
+	TRACE(sp, "delete %lu lines at %lu\n", (u_long)cnt, (u_long)lno);
 #endif
 	/* Check for no underlying file. */
 	if ((ep = sp->ep) == NULL) {
 		ex_emsg(sp, NULL, EXM_NOFILEYET);
 		return (1);
 	}
-		
+	if (cnt == 0)
+		return (0);
+
 	/* Update marks, @ and global commands. */
-	if (mark_insdel(sp, LINE_DELETE, lno))
+	if (mark_insdel(sp, LINE_DELETE, lno, cnt))
 		return (1);
-	if (ex_g_insdel(sp, LINE_DELETE, lno))
+	if (ex_g_insdel(sp, LINE_DELETE, lno, cnt))
 		return (1);
 
-	/* Log change. */
-	log_line(sp, lno, LOG_LINE_DELETE);
+	/*
+	 * Log change.  The lines are logged last to first, so that undo
+	 * re-inserts them in order.
+	 */
+	for (l = lno + cnt; l-- > lno;)
+		log_line(sp, l, LOG_LINE_DELETE);
 
 	/* Update file. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	if (ep->db->del(ep->db, &key, 0) == 1) {
+	if (ep->ls->del(ep->ls, lno, cnt) != 0) {
 		msgq(sp, M_SYSERR,
 		    "003|unable to delete line %lu", (u_long)lno);
 		return (1);
 	}
 
-	/* Flush the cache, update line count, before screen update. */
-	if (lno <= ep->c_lno)
-		ep->c_lno = OOBLNO;
+	/* Update the cache and line count, before screen update. */
+	db_cshift(ep, lno, cnt, lno + cnt, -(long)cnt);
 	if (ep->c_nlines != OOBLNO)
-		--ep->c_nlines;
+		ep->c_nlines -= cnt;
 
 	/* File now modified. */
 	if (F_ISSET(ep, F_FIRSTMODIFY))
@@ -240,7 +273,7 @@ db_delete(SCR *sp, recno_t lno)
 	F_SET(ep, F_MODIFIED);
 
 	/* Update screen. */
-	return (scr_update(sp, lno, LINE_DELETE, 1));
+	return (scr_update(sp, lno, LINE_DELETE, cnt, 1));
 }
 
 /*
@@ -252,7 +285,6 @@ db_delete(SCR *sp, recno_t lno)
 int
 db_append(SCR *sp, int update, recno_t lno, CHAR_T *p, size_t len)
 {
-	DBT data, key;
 	EXF *ep;
 	char *fp;
 	size_t flen;
@@ -270,19 +302,14 @@ db_append(SCR *sp, int update, recno_t lno, CHAR_T *p, size_t len)
 	INT2FILE(sp, p, len, fp, flen);
 
 	/* Update file. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	data.data = fp;
-	data.size = flen;
-	if (ep->db->put(ep->db, &key, &data, R_IAFTER) == -1) {
+	if (ep->ls->iafter(ep->ls, lno, fp, flen) == -1) {
 		msgq(sp, M_SYSERR,
 		    "004|unable to append to line %lu", (u_long)lno);
 		return (1);
 	}
 
-	/* Flush the cache, update line count, before screen update. */
-	if (lno < ep->c_lno)
-		ep->c_lno = OOBLNO;
+	/* Update the cache and line count, before screen update. */
+	db_cshift(ep, OOBLNO, 0, lno + 1, 1);
 	if (ep->c_nlines != OOBLNO)
 		++ep->c_nlines;
 
@@ -296,9 +323,9 @@ db_append(SCR *sp, int update, recno_t lno, CHAR_T *p, size_t len)
 
 	/* Update marks, @ and global commands. */
 	rval = 0;
-	if (mark_insdel(sp, LINE_INSERT, lno + 1))
+	if (mark_insdel(sp, LINE_INSERT, lno + 1, 1))
 		rval = 1;
-	if (ex_g_insdel(sp, LINE_INSERT, lno + 1))
+	if (ex_g_insdel(sp, LINE_INSERT, lno + 1, 1))
 		rval = 1;
 
 	/*
@@ -311,7 +338,72 @@ db_append(SCR *sp, int update, recno_t lno, CHAR_T *p, size_t len)
 	 * is called to copy the new lines from the cut buffer into the file,
 	 * it has to know not to update the screen again.
 	 */
-	return (scr_update(sp, lno, LINE_APPEND, update) || rval);
+	return (scr_update(sp, lno, LINE_APPEND, 1, update) || rval);
+}
+
+/*
+ * db_append_lines --
+ *	Append cnt lines, taken from the TEXT list starting at tp, into
+ *	the file.  The marks, @ and global commands and screens are each
+ *	updated once for all of the lines.
+ *
+ * PUBLIC: int db_append_lines(SCR *, int, recno_t, TEXT *, recno_t);
+ */
+int
+db_append_lines(SCR *sp, int update, recno_t lno, TEXT *tp, recno_t cnt)
+{
+	EXF *ep;
+	TEXT *ftp;
+	char *fp;
+	size_t flen;
+	recno_t n;
+	int rval;
+
+#if defined(DEBUG) && 0
+	TRACE(sp, "append %lu lines to %lu\n", (u_long)cnt, (u_long)lno);
+#endif
+	/* Check for no underlying file. */
+	if ((ep = sp->ep) == NULL) {
+		ex_emsg(sp, NULL, EXM_NOFILEYET);
+		return (1);
+	}
+
+	/* Update file. */
+	rval = 0;
+	for (ftp = tp, n = 0; n < cnt; ++n, tp = TAILQ_NEXT(tp, q)) {
+		INT2FILE(sp, tp->lb, tp->len, fp, flen);
+		if (ep->ls->iafter(ep->ls, lno + n, fp, flen) == -1) {
+			msgq(sp, M_SYSERR,
+			    "004|unable to append to line %lu",
+			    (u_long)(lno + n));
+			rval = 1;
+			break;
+		}
+	}
+	if (n == 0)
+		return (rval);
+
+	/* Update the cache and line count, before screen update. */
+	db_cshift(ep, OOBLNO, 0, lno + 1, n);
+	if (ep->c_nlines != OOBLNO)
+		ep->c_nlines += n;
+
+	/* File now dirty. */
+	if (F_ISSET(ep, F_FIRSTMODIFY))
+		(void)rcv_init(sp);
+	F_SET(ep, F_MODIFIED);
+
+	/* Log change. */
+	log_lines(sp, lno + 1, ftp, n);
+
+	/* Update marks, @ and global commands. */
+	if (mark_insdel(sp, LINE_INSERT, lno + 1, n))
+		rval = 1;
+	if (ex_g_insdel(sp, LINE_INSERT, lno + 1, n))
+		rval = 1;
+
+	/* Update screen, see db_append. */
+	return (scr_update(sp, lno, LINE_APPEND, n, update) || rval);
 }
 
 /*
@@ -323,7 +415,6 @@ db_append(SCR *sp, int update, recno_t lno, CHAR_T *p, size_t len)
 int
 db_insert(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 {
-	DBT data, key;
 	EXF *ep;
 	char *fp;
 	size_t flen;
@@ -342,19 +433,14 @@ db_insert(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 	INT2FILE(sp, p, len, fp, flen);
 		
 	/* Update file. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	data.data = fp;
-	data.size = flen;
-	if (ep->db->put(ep->db, &key, &data, R_IBEFORE) == -1) {
+	if (ep->ls->iafter(ep->ls, lno - 1, fp, flen) == -1) {
 		msgq(sp, M_SYSERR,
 		    "005|unable to insert at line %lu", (u_long)lno);
 		return (1);
 	}
 
-	/* Flush the cache, update line count, before screen update. */
-	if (lno >= ep->c_lno)
-		ep->c_lno = OOBLNO;
+	/* Update the cache and line count, before screen update. */
+	db_cshift(ep, OOBLNO, 0, lno, 1);
 	if (ep->c_nlines != OOBLNO)
 		++ep->c_nlines;
 
@@ -368,13 +454,13 @@ db_insert(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 
 	/* Update marks, @ and global commands. */
 	rval = 0;
-	if (mark_insdel(sp, LINE_INSERT, lno))
+	if (mark_insdel(sp, LINE_INSERT, lno, 1))
 		rval = 1;
-	if (ex_g_insdel(sp, LINE_INSERT, lno))
+	if (ex_g_insdel(sp, LINE_INSERT, lno, 1))
 		rval = 1;
 
 	/* Update screen. */
-	return (scr_update(sp, lno, LINE_INSERT, 1) || rval);
+	return (scr_update(sp, lno, LINE_INSERT, 1, 1) || rval);
 }
 
 /*
@@ -386,7 +472,6 @@ db_insert(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 int
 db_set(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 {
-	DBT data, key;
 	EXF *ep;
 	char *fp;
 	size_t flen;
@@ -407,19 +492,14 @@ db_set(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 	INT2FILE(sp, p, len, fp, flen);
 
 	/* Update file. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	data.data = fp;
-	data.size = flen;
-	if (ep->db->put(ep->db, &key, &data, 0) == -1) {
+	if (ep->ls->put(ep->ls, lno, fp, flen) == -1) {
 		msgq(sp, M_SYSERR,
 		    "006|unable to store line %lu", (u_long)lno);
 		return (1);
 	}
 
 	/* Flush the cache, before logging or screen update. */
-	if (lno == ep->c_lno)
-		ep->c_lno = OOBLNO;
+	db_cshift(ep, lno, 1, OOBLNO, 0);
 
 	/* File now dirty. */
 	if (F_ISSET(ep, F_FIRSTMODIFY))
@@ -430,7 +510,7 @@ db_set(SCR *sp, recno_t lno, CHAR_T *p, size_t len)
 	log_line(sp, lno, LOG_LINE_RESET_F);
 
 	/* Update screen. */
-	return (scr_update(sp, lno, LINE_RESET, 1));
+	return (scr_update(sp, lno, LINE_RESET, 1, 1));
 }
 
 /*
@@ -475,11 +555,9 @@ db_exist(SCR *sp, recno_t lno)
 int
 db_last(SCR *sp, recno_t *lnop)
 {
-	DBT data, key;
 	EXF *ep;
 	recno_t lno;
-	CHAR_T *wp;
-	size_t wlen;
+	int busy, rval;
 
 	/* Check for no underlying file. */
 	if ((ep = sp->ep) == NULL) {
@@ -499,33 +577,17 @@ db_last(SCR *sp, recno_t *lnop)
 		return (0);
 	}
 
-	key.data = &lno;
-	key.size = sizeof(lno);
-
-	switch (ep->db->seq(ep->db, &key, &data, R_LAST)) {
-	case -1:
-alloc_err:
+	/* If the file is still loading, wait for it. */
+	busy = ep->ls->loaded(ep->ls, &lno) == 1;
+	if (busy)
+		sp->gp->scr_busy(sp, "328|Loading...", BUSY_ON);
+	rval = ep->ls->last(ep->ls, &lno);
+	if (busy)
+		sp->gp->scr_busy(sp, NULL, BUSY_OFF);
+	if (rval) {
 		msgq(sp, M_SYSERR, "007|unable to get last line");
 		*lnop = 0;
 		return (1);
-	case 1:
-		*lnop = 0;
-		return (0);
-	}
-
-	memcpy(&lno, key.data, sizeof(lno));
-
-	if (lno != ep->c_lno) {
-		FILE2INT(sp, data.data, data.size, wp, wlen);
-
-		/* Fill the cache. */
-		if (wp != data.data) {
-			BINC_GOTOW(sp, ep->c_lp, ep->c_blen, wlen);
-			MEMCPY(ep->c_lp, wp, wlen);
-		} else
-			ep->c_lp = data.data;
-		ep->c_lno = lno;
-		ep->c_len = wlen;
 	}
 	ep->c_nlines = lno;
 
@@ -536,9 +598,26 @@ alloc_err:
 	return (0);
 }
 
+/*
+ * db_loading --
+ *	Return if the file is still being loaded, and the number of lines
+ *	loaded so far.
+ *
+ * PUBLIC: int db_loading(SCR *, recno_t *);
+ */
+int
+db_loading(SCR *sp, recno_t *lnop)
+{
+	EXF *ep;
+
+	if ((ep = sp->ep) == NULL || ep->c_nlines != OOBLNO)
+		return (0);
+	return (ep->ls->loaded(ep->ls, lnop) == 1);
+}
+
 /*
  * db_rget --
- *	Retrieve a raw line from the database.
+ *	Retrieve a raw line from the line store.
  *
  * PUBLIC: int db_rget(SCR *, recno_t, char **, size_t *);
  */
@@ -548,40 +627,164 @@ db_rget(SCR *sp,
 	char **pp,				/* Pointer store. */
 	size_t *lenp)				/* Length store. */
 {
-	DBT data, key;
 	EXF *ep = sp->ep;
-	int rval;
 
-	/* Get the line from the underlying database. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	if ((rval = ep->db->get(ep->db, &key, &data, 0)) == 0)
-	{
-		*lenp = data.size;
-		*pp = data.data;
-	}
+	/* Get the line from the underlying line store. */
+	return (ep->ls->get(ep->ls, lno, pp, lenp));
+}
 
-	return (rval);
+/*
+ * db_rspan --
+ *	Retrieve a run of raw lines, with their <newline>s, from the line
+ *	store.  The number of lines returned may be 0, see lstore.h.
+ *
+ * PUBLIC: int db_rspan(SCR *, recno_t, recno_t, char **, size_t *, recno_t *);
+ */
+int
+db_rspan(SCR *sp,
+	recno_t lno,				/* Line number. */
+	recno_t cnt,				/* Line count. */
+	char **pp,				/* Pointer store. */
+	size_t *lenp,				/* Length store. */
+	recno_t *np)				/* Lines returned store. */
+{
+	EXF *ep = sp->ep;
+
+	return (ep->ls->span(ep->ls, lno, cnt, pp, lenp, np));
 }
 
 /*
  * db_rset --
- *	Store a raw line into the database.
+ *	Store a raw line into the line store.
  *
  * PUBLIC: int db_rset(SCR *, recno_t, char *, size_t);
  */
 int
 db_rset(SCR *sp, recno_t lno, char *p, size_t len)
 {
-	DBT data, key;
 	EXF *ep = sp->ep;
 
 	/* Update file. */
-	key.data = &lno;
-	key.size = sizeof(lno);
-	data.data = p;
-	data.size = len;
-	return ep->db->put(ep->db, &key, &data, 0);
+	return (ep->ls->put(ep->ls, lno, p, len));
+}
+
+/*
+ * db_rset_end --
+ *	Finish storing raw lines, between line lno and line lno + cnt - 1,
+ *	with db_rset.  The cache and the screens are each updated once for
+ *	all of the lines.
+ *
+ * PUBLIC: int db_rset_end(SCR *, recno_t, recno_t);
+ */
+int
+db_rset_end(SCR *sp, recno_t lno, recno_t cnt)
+{
+	EXF *ep = sp->ep;
+
+	/* Flush the cache, before screen update. */
+	db_cshift(ep, lno, cnt, OOBLNO, 0);
+
+	/* File now dirty. */
+	if (F_ISSET(ep, F_FIRSTMODIFY))
+		(void)rcv_init(sp);
+	F_SET(ep, F_MODIFIED);
+
+	/* Update screen. */
+	return (scr_update(sp, lno, LINE_RESET, cnt, 1));
+}
+
+/*
+ * db_csize --
+ *	Set the number of lines in the current file's line cache.
+ *
+ * PUBLIC: int db_csize(SCR *, u_long);
+ */
+int
+db_csize(SCR *sp, u_long size)
+{
+	EXF *ep;
+	LCACHE *lcp;
+	size_t i;
+
+	if ((ep = sp->ep) == NULL || size == ep->c_size)
+		return (0);
+
+	/* Discard the least recently used lines that no longer fit. */
+	for (i = size; i < ep->c_size; ++i)
+		free(ep->c_lines[i].lp);
+	if ((lcp = realloc(ep->c_lines, size * sizeof(LCACHE))) == NULL) {
+		msgq(sp, M_SYSERR, NULL);
+		ep->c_cnt = MIN(ep->c_cnt, size);
+		ep->c_size = MIN(ep->c_size, size);
+		return (1);
+	}
+	if (size > ep->c_size)
+		memset(lcp + ep->c_size, 0,
+		    (size - ep->c_size) * sizeof(LCACHE));
+	ep->c_lines = lcp;
+	ep->c_cnt = MIN(ep->c_cnt, size);
+	ep->c_size = size;
+	return (0);
+}
+
+/*
+ * db_cfree --
+ *	Free a file's line cache.
+ *
+ * PUBLIC: void db_cfree(EXF *);
+ */
+void
+db_cfree(EXF *ep)
+{
+	size_t i;
+
+	for (i = 0; i < ep->c_size; ++i)
+		free(ep->c_lines[i].lp);
+	free(ep->c_lines);
+	ep->c_lines = NULL;
+	ep->c_cnt = ep->c_size = 0;
+}
+
+/*
+ * db_cmove --
+ *	Move a line cache entry to a new position, returning the entry.
+ */
+static LCACHE *
+db_cmove(EXF *ep, size_t from, size_t to)
+{
+	LCACHE t;
+
+	if (from == to)
+		return (&ep->c_lines[to]);
+	t = ep->c_lines[from];
+	if (from > to)
+		memmove(ep->c_lines + to + 1,
+		    ep->c_lines + to, (from - to) * sizeof(LCACHE));
+	else
+		memmove(ep->c_lines + from,
+		    ep->c_lines + from + 1, (to - from) * sizeof(LCACHE));
+	ep->c_lines[to] = t;
+	return (&ep->c_lines[to]);
+}
+
+/*
+ * db_cshift --
+ *	Discard the cached copies of the dcnt lines starting at dlno, and
+ *	adjust the numbers of cached lines from lno on by incr.
+ */
+static void
+db_cshift(EXF *ep, recno_t dlno, recno_t dcnt, recno_t lno, long incr)
+{
+	size_t i;
+
+	for (i = 0; i < ep->c_cnt; ++i)
+		if (ep->c_lines[i].lno >= dlno &&
+		    ep->c_lines[i].lno - dlno < dcnt) {
+			/* Move it past the end of the list, to be reused. */
+			db_cmove(ep, i, --ep->c_cnt)->lno = OOBLNO;
+			--i;
+		} else if (lno != OOBLNO && ep->c_lines[i].lno >= lno)
+			ep->c_lines[i].lno += incr;
 }
 
 /*
@@ -603,7 +806,7 @@ db_err(SCR *sp, recno_t lno)
  *	just changed.
  */
 static int
-scr_update(SCR *sp, recno_t lno, lnop_t op, int current)
+scr_update(SCR *sp, recno_t lno, lnop_t op, recno_t cnt, int current)
 {
 	EXF *ep;
 	SCR *tsp;
@@ -615,7 +818,7 @@ scr_update(SCR *sp, recno_t lno, lnop_t op, int current)
 	if (ep->refcnt != 1)
 		TAILQ_FOREACH(tsp, sp->gp->dq, q)
 			if (sp != tsp && tsp->ep == ep)
-				if (vs_change(tsp, lno, op))
+				if (vs_nchange(tsp, lno, op, cnt))
 					return (1);
-	return (current ? vs_change(sp, lno, op) : 0);
+	return (current ? vs_nchange(sp, lno, op, cnt) : 0);
 }
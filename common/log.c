@@ -22,9 +22,18 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "common.h"
 
+typedef struct {
+	recno_t	lno;			/* Line number. */
+	size_t	pre;			/* Unchanged leading characters. */
+	size_t	suf;			/* Unchanged trailing characters. */
+	size_t	blen;			/* Changed characters before. */
+	size_t	flen;			/* Changed characters after. */
+} log_reset_t;
+
 /*
  * The log consists of records, each containing a type byte and a variable
  * length byte string, as follows:
@@ -34,37 +43,88 @@
  *	LOG_LINE_APPEND 	recno_t		char *
  *	LOG_LINE_DELETE		recno_t		char *
  *	LOG_LINE_INSERT		recno_t		char *
- *	LOG_LINE_RESET_F	recno_t		char *
- *	LOG_LINE_RESET_B	recno_t		char *
+ *	LOG_LINE_GROUP		[log_reset_t	char *] ...
  *	LOG_MARK		LMARK
  *
  * We do before image physical logging.  This means that the editor layer
  * MAY NOT modify records in place, even if simply deleting or overwriting
- * characters.  Since the smallest unit of logging is a line, we're using
- * up lots of space.  This may eventually have to be reduced, probably by
- * doing logical logging, which is a much cooler database phrase.
+ * characters.  Since the smallest unit of logging is a line, we'd use up
+ * lots of space logging the changes to long lines, so the line resets are
+ * logged logically: only the characters between the start and the end of
+ * the line that the change didn't touch are logged, once as they were
+ * before the change and once as they were after it.  Replaying a reset
+ * keeps those characters of the line it's applied to, which should be the
+ * other image, and checks its length.  A line that's already the image
+ * being replayed, e.g. one the 'U' command skipped, is left alone.
+ *
+ * The LOG_LINE_RESET_B and LOG_LINE_RESET_F calls to log_line aren't
+ * records of their own.  The line is saved by the first, and the reset is
+ * added to a LOG_LINE_GROUP record by the second.  A group collects the
+ * resets of a run of lines in ascending order, e.g. the lines changed by a
+ * substitute or shift command, up to LOG_GROUPLEN bytes, and is put out
+ * when the run ends or any other record is logged.  A group is replayed as
+ * a single change to the file, with one screen update for all of its lines.
  *
  * The implementation of the historic vi 'u' command, using roll-forward and
  * roll-back, is simple.  Each set of changes has a LOG_CURSOR_INIT record,
  * followed by a number of other records, followed by a LOG_CURSOR_END record.
- * LOG_LINE_RESET records come in pairs.  The first is a LOG_LINE_RESET_B
- * record, and is the line before the change.  The second is LOG_LINE_RESET_F,
- * and is the line after the change.  Roll-back is done by backing up to the
- * first LOG_CURSOR_INIT record before a change.  Roll-forward is done in a
- * similar fashion.
+ * Roll-back is done by backing up to the first LOG_CURSOR_INIT record before
+ * a change.  Roll-forward is done in a similar fashion.  Runs of records
+ * that append or delete adjacent lines are replayed as a single deletion.
  *
  * The 'U' command is implemented by rolling backward to a LOG_CURSOR_END
  * record for a line different from the current one.  It should be noted that
  * this means that a subsequent 'u' command will make a change based on the
  * new position of the log's cursor.  This is okay, and, in fact, historic vi
  * behaved that way.
+ *
+ * The log isn't a db, it's kept in memory, in segments of an append-only
+ * arena (see log.h), and the log's cursor and high water mark are offsets
+ * into it.  Each record is stored as its length, the record, padded so the
+ * next record is aligned, and its length again.  Records are never changed,
+ * and only discarded when a change is logged after an undo.  When the log
+ * has more than the undocache option's kilobytes in memory, the oldest
+ * segments are written to an unlinked temporary file, at their own offsets,
+ * and freed.  They're read back in when the log is rolled back over them.
+ *
+ * If the undofile option is set, the log is saved in the recovery directory
+ * each time the whole file is written, and used again the next time the
+ * file is edited, if it hasn't changed since.  Only the undo file's header
+ * is read when the file is edited.  The log then starts at the saved cursor,
+ * l_base, rather than at 0, and the saved segments are added to it, as if
+ * they had been spilled, when it's rolled back or forward from there.  The
+ * saved history is checked against a hash of the text before the first
+ * record is logged, and dropped if the text has changed.
+ *
+ * If the undolimit option is set, the oldest changes are discarded when the
+ * log grows past its kilobytes, by moving l_base up to a LOG_CURSOR_INIT
+ * record and freeing the segments before it.  The change being made and the
+ * changes after the log's cursor are never discarded.  The undo file is
+ * written again from the start of the log the next time it's saved.
  */
 
+static int	log_bad(SCR *);
+static int	log_check(SCR *, char *, size_t, size_t *);
 static int	log_cursor1(SCR *, int);
+static int	log_evict(SCR *);
+static int	log_flush(SCR *);
+static int	log_hash(SCR *, recno_t, recno_t, u_int64_t *);
+static int	log_image(SCR *, log_reset_t *, u_char *, int, size_t *);
+static int	log_line1(SCR *, recno_t, u_int, CHAR_T *, size_t);
+static int	log_load(SCR *, int);
+static int	log_next(SCR *, u_char **, size_t *);
+static char    *log_path(SCR *, char **);
+static int	log_prev(SCR *, u_char **, size_t *);
+static int	log_put(SCR *, size_t);
+static int	log_reset(SCR *, recno_t, CHAR_T *, size_t);
+static LOGSEG  *log_seg(SCR *, size_t);
+static int	log_spill(SCR *, size_t);
+static int	log_verify(SCR *, recno_t, recno_t);
 static void	log_err(SCR *, char *, int);
 #if defined(DEBUG) && 0
-static void	log_trace(SCR *, char *, recno_t, u_char *);
+static void	log_trace(SCR *, char *, size_t, u_char *);
 #endif
+static int	apply_group(SCR *, u_char *, size_t, int);
 static int	apply_with(int (*)(SCR *, recno_t, CHAR_T *, size_t),
 					SCR *, recno_t, u_char *, size_t);
 
@@ -83,6 +143,32 @@ typedef struct {
 } log_t;
 #define CHAR_T_OFFSET ((char *)(((log_t*)0)->str) - (char *)0)
 
+/*
+ * Each line reset in a group is a log_reset_t, followed by the changed
+ * characters before and after the change, none of which is aligned.
+ */
+#define	RESET_LEN(lrp)							\
+	(sizeof(log_reset_t) + ((lrp)->blen + (lrp)->flen) * sizeof(CHAR_T))
+
+/* Length of a record of n bytes in the log, including its framing. */
+#define	LOG_RECLEN(n)							\
+	(((n) + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t) +	\
+	    2 * sizeof(size_t))
+
+/* File offset of a log offset in the spill and undo files. */
+#define	LOG_FOFF(off)	((off_t)(sizeof(LOGHDR) + (off)))
+
+/*
+ * File offset of a segment that's not in memory.  The undo file's records
+ * start at the log offset of its first record, l_ustart.
+ */
+#define	LOG_SOFF(ep, segp)						\
+	LOG_FOFF((segp)->off - ((segp)->spilled ? 0 : (ep)->l_ustart))
+
+/* 64-bit FNV-1a hash, of the undo file's path and text. */
+#define	LOG_FNV_INIT	14695981039346656037ULL
+#define	LOG_FNV(h, ch)	(((h) ^ (u_char)(ch)) * 1099511628211ULL)
+
 /*
  * log_init --
  *	Initialize the logging subsystem.
@@ -102,18 +188,24 @@ log_init(SCR *sp, EXF *ep)
 	 */
 	ep->l_lp = NULL;
 	ep->l_len = 0;
+	ep->l_bp = NULL;
+	ep->l_blen = 0;
+	ep->l_gcnt = 0;
 	ep->l_cursor.lno = 1;		/* XXX Any valid recno. */
 	ep->l_cursor.cno = 0;
-	ep->l_high = ep->l_cur = 1;
-
-	ep->log = dbopen(NULL, O_CREAT | O_NONBLOCK | O_RDWR,
-	    S_IRUSR | S_IWUSR, DB_RECNO, NULL);
-	if (ep->log == NULL) {
-		msgq(sp, M_SYSERR, "009|Log file");
-		F_SET(ep, F_NOLOG);
-		return (1);
-	}
+	ep->l_base = ep->l_high = ep->l_cur = 0;
+	ep->l_linit = 0;
+	ep->l_evicts = ep->l_evbytes = 0;
 
+	ep->l_seg = NULL;
+	ep->l_nseg = ep->l_sseg = 0;
+	ep->l_cold = 0;
+	ep->l_mem = 0;
+	ep->l_fd = -1;
+	ep->l_ufd = -1;
+	ep->l_upath = NULL;
+	ep->l_ustart = 0;
+	ep->l_hdr = NULL;
 	return (0);
 }
 
@@ -130,17 +222,273 @@ log_end(SCR *sp, EXF *ep)
 	 * !!!
 	 * ep MAY NOT BE THE SAME AS sp->ep, DON'T USE THE LATTER.
 	 */
-	if (ep->log != NULL) {
-		(void)(ep->log->close)(ep->log);
-		ep->log = NULL;
+	while (ep->l_nseg > 0)
+		free(ep->l_seg[--ep->l_nseg].bp);
+	free(ep->l_seg);
+	ep->l_seg = NULL;
+	ep->l_sseg = 0;
+	ep->l_cold = 0;
+	ep->l_mem = 0;
+	if (ep->l_fd != -1) {
+		(void)close(ep->l_fd);
+		ep->l_fd = -1;
 	}
+	if (ep->l_ufd != -1) {
+		(void)close(ep->l_ufd);
+		ep->l_ufd = -1;
+	}
+	free(ep->l_upath);
+	ep->l_upath = NULL;
+	ep->l_ustart = 0;
+	free(ep->l_hdr);
+	ep->l_hdr = NULL;
 	free(ep->l_lp);
 	ep->l_lp = NULL;
 	ep->l_len = 0;
+	free(ep->l_bp);
+	ep->l_bp = NULL;
+	ep->l_blen = 0;
+	ep->l_gcnt = 0;
 	ep->l_cursor.lno = 1;		/* XXX Any valid recno. */
 	ep->l_cursor.cno = 0;
-	ep->l_high = ep->l_cur = 1;
+	ep->l_base = ep->l_high = ep->l_cur = 0;
+	ep->l_linit = 0;
+	return (0);
+}
+
+/*
+ * log_open --
+ *	Find the history saved for the file in its undo file, if there is
+ *	one, and the file hasn't changed since.  Only the undo file's header
+ *	is read, see log_load.
+ *
+ * PUBLIC: int log_open(SCR *);
+ */
+int
+log_open(SCR *sp)
+{
+	EXF *ep;
+	LOGHDR hdr;
+	struct stat sb, usb;
+	size_t fsize, rlen;
+	int fd;
+	char *key, *kp, *path;
+
+	ep = sp->ep;
+	if (!O_ISSET(sp, O_UNDOFILE) ||
+	    F_ISSET(sp->frp, FR_TMPFILE) || !F_ISSET(ep, F_DEVSET))
+		return (0);
+	if ((path = log_path(sp, &key)) == NULL)
+		return (0);
+	kp = NULL;
+
+	/*
+	 * The recovery directory is writable by everyone.  Don't follow
+	 * links, and only use a regular file that belongs to the user, and
+	 * that only the user can read or write.
+	 */
+	if ((fd = open(path, O_RDWR | O_NOFOLLOW)) == -1)
+		goto err;
+	if (fstat(fd, &usb) || !S_ISREG(usb.st_mode) ||
+	    usb.st_uid != getuid() ||
+	    (usb.st_mode & (S_IRWXU | S_IRWXG | S_IRWXO)) !=
+	    (S_IRUSR | S_IWUSR))
+		goto err;
+
+	/*
+	 * The records, the segment table and the path have to end at the
+	 * end of the file.
+	 */
+	if (pread(fd, &hdr, sizeof(LOGHDR), 0) != sizeof(LOGHDR) ||
+	    hdr.magic != LOG_MAGIC || hdr.version != LOG_VERSION ||
+	    hdr.start > hdr.base || hdr.base > hdr.cur ||
+	    hdr.cur > hdr.high || hdr.plen != strlen(key))
+		goto err;
+	fsize = usb.st_size;
+	rlen = hdr.high - hdr.start;
+	if (fsize < sizeof(LOGHDR) || rlen > fsize - sizeof(LOGHDR) ||
+	    hdr.plen > fsize - sizeof(LOGHDR) - rlen ||
+	    hdr.nseg != (fsize - sizeof(LOGHDR) - rlen - hdr.plen) /
+	    (2 * sizeof(size_t)) ||
+	    (fsize - sizeof(LOGHDR) - rlen - hdr.plen) %
+	    (2 * sizeof(size_t)) != 0)
+		goto err;
+	if (stat(sp->frp->name, &sb) || hdr.dev != sb.st_dev ||
+	    hdr.ino != sb.st_ino || hdr.size != sb.st_size ||
+	    timespeccmp(&hdr.mtim, &sb.st_mtim, !=))
+		goto err;
+	if ((kp = malloc(hdr.plen)) == NULL ||
+	    pread(fd, kp, hdr.plen, LOG_FOFF(rlen) +
+	    hdr.nseg * 2 * sizeof(size_t)) != (ssize_t)hdr.plen ||
+	    memcmp(kp, key, hdr.plen))
+		goto err;
+	if ((ep->l_hdr = malloc(sizeof(LOGHDR))) == NULL)
+		goto err;
+	memmove(ep->l_hdr, &hdr, sizeof(LOGHDR));
+	ep->l_ufd = fd;
+	ep->l_upath = path;
+	ep->l_ustart = hdr.start;
+	ep->l_base = ep->l_high = ep->l_cur = hdr.cur;
+	free(kp);
+	free(key);
+	return (0);
+
+err:	if (fd != -1)
+		(void)close(fd);
+	free(kp);
+	free(key);
+	free(path);
+	return (0);
+}
+
+/*
+ * log_save --
+ *	Save the log in the file's undo file.  Called after the whole file
+ *	has been written to its own name.
+ *
+ * PUBLIC: int log_save(SCR *);
+ */
+int
+log_save(SCR *sp)
+{
+	EXF *ep;
+	LOGHDR hdr;
+	LOGSEG *segp;
+	struct stat sb;
+	off_t foff;
+	size_t ent[2], i, start;
+	int fd;
+	char *key, *p, *path, *tname;
+
+	ep = sp->ep;
+	if (!O_ISSET(sp, O_UNDOFILE) ||
+	    F_ISSET(ep, F_NOLOG) || F_ISSET(sp->frp, FR_TMPFILE))
+		return (0);
+	key = path = tname = NULL;
+	fd = -1;
+	if (log_flush(sp))
+		return (1);
+
+	/*
+	 * The history that hasn't been read yet is saved again.  If changes
+	 * were logged, it was checked against the text before the first of
+	 * them, see log_verify.  Otherwise, check it now.  If it doesn't
+	 * match, only this session's changes are saved.
+	 */
+	if (ep->l_hdr != NULL)
+		(void)log_load(sp, ep->l_high == ep->l_base);
+
+	if ((path = log_path(sp, &key)) == NULL)
+		goto err;
+
+	/*
+	 * Invalidate the undo file while it's written.  If the file's been
+	 * renamed, or there wasn't one, or changes at the start of the log
+	 * have been discarded since it was written, write all of the log to
+	 * a new file, and rename it into place when it's complete.  The new
+	 * file is made with mkstemp(3), as the recovery directory is writable
+	 * by everyone.
+	 */
+	memset(&hdr, 0, sizeof(LOGHDR));
+	start = ep->l_nseg != 0 ? ep->l_seg[0].off : ep->l_base;
+	if (ep->l_upath != NULL && !strcmp(path, ep->l_upath) &&
+	    ep->l_nseg != 0 && start == ep->l_ustart) {
+		fd = ep->l_ufd;
+		if (pwrite(fd, &hdr, sizeof(LOGHDR), 0) != sizeof(LOGHDR))
+			goto err;
+	} else {
+		if ((tname =
+		    join(O_STR(sp, O_RECDIR), "undo.XXXXXXXXXX")) == NULL)
+			goto err;
+		if ((fd = mkstemp(tname)) == -1)
+			goto err;
+		(void)fchmod(fd, S_IRUSR | S_IWUSR);
+	}
+
+	for (i = 0; i < ep->l_nseg; ++i) {
+		segp = ep->l_seg + i;
+		if (segp->saved && fd == ep->l_ufd)
+			continue;
+		if ((p = segp->bp) == NULL) {
+			if ((p = malloc(segp->len)) == NULL)
+				goto err;
+			if (pread(segp->spilled ? ep->l_fd : ep->l_ufd, p,
+			    segp->len, LOG_SOFF(ep, segp)) !=
+			    (ssize_t)segp->len) {
+				free(p);
+				goto err;
+			}
+		}
+		if (pwrite(fd, p, segp->len,
+		    LOG_FOFF(segp->off - start)) != (ssize_t)segp->len) {
+			if (p != segp->bp)
+				free(p);
+			goto err;
+		}
+		if (p != segp->bp)
+			free(p);
+	}
+
+	/* Write the segment table and the path, then the header. */
+	foff = LOG_FOFF(ep->l_high - start);
+	for (i = 0; i < ep->l_nseg; ++i, foff += sizeof(ent)) {
+		ent[0] = ep->l_seg[i].off;
+		ent[1] = ep->l_seg[i].len;
+		if (pwrite(fd, ent, sizeof(ent), foff) != sizeof(ent))
+			goto err;
+	}
+	hdr.plen = strlen(key);
+	if (pwrite(fd, key, hdr.plen, foff) != (ssize_t)hdr.plen ||
+	    ftruncate(fd, foff + hdr.plen))
+		goto err;
+	if (log_hash(sp, 0, 0, &hdr.hash) || stat(sp->frp->name, &sb))
+		goto err;
+	hdr.magic = LOG_MAGIC;
+	hdr.version = LOG_VERSION;
+	hdr.dev = sb.st_dev;
+	hdr.ino = sb.st_ino;
+	hdr.size = sb.st_size;
+	hdr.mtim = sb.st_mtim;
+	hdr.start = start;
+	hdr.base = ep->l_base;
+	hdr.cur = ep->l_cur;
+	hdr.high = ep->l_high;
+	hdr.nseg = ep->l_nseg;
+	if (pwrite(fd, &hdr, sizeof(LOGHDR), 0) != sizeof(LOGHDR))
+		goto err;
+	if (tname != NULL) {
+		if (rename(tname, path))
+			goto err;
+		free(tname);
+		tname = NULL;
+	}
+
+	for (i = 0; i < ep->l_nseg; ++i)
+		ep->l_seg[i].saved = 1;
+	if (fd != ep->l_ufd) {
+		if (ep->l_ufd != -1)
+			(void)close(ep->l_ufd);
+		free(ep->l_upath);
+		ep->l_ufd = fd;
+		ep->l_upath = path;
+		ep->l_ustart = start;
+	} else
+		free(path);
+	free(key);
 	return (0);
+
+err:	msgq_str(sp, M_SYSERR,
+	    sp->frp->name, "333|%s: unable to save the undo history");
+	if (fd != -1 && fd != ep->l_ufd)
+		(void)close(fd);
+	if (tname != NULL) {
+		if (fd != -1)
+			(void)unlink(tname);
+		free(tname);
+	}
+	free(path);
+	free(key);
+	return (1);
 }
 
 /*
@@ -179,30 +527,26 @@ log_cursor(SCR *sp)
 static int
 log_cursor1(SCR *sp, int type)
 {
-	DBT data, key;
 	EXF *ep;
 
 	ep = sp->ep;
+	if (log_flush(sp))
+		return (1);
 
 	BINC_RETC(sp, ep->l_lp, ep->l_len, sizeof(u_char) + sizeof(MARK));
 	ep->l_lp[0] = type;
 	memmove(ep->l_lp + sizeof(u_char), &ep->l_cursor, sizeof(MARK));
-
-	key.data = &ep->l_cur;
-	key.size = sizeof(recno_t);
-	data.data = ep->l_lp;
-	data.size = sizeof(u_char) + sizeof(MARK);
-	if (ep->log->put(ep->log, &key, &data, 0) == -1)
-		LOG_ERR;
+	if (log_put(sp, sizeof(u_char) + sizeof(MARK)))
+		return (1);
+	if (type == LOG_CURSOR_INIT)
+		ep->l_linit =
+		    ep->l_cur - LOG_RECLEN(sizeof(u_char) + sizeof(MARK));
 
 #if defined(DEBUG) && 0
 	TRACE(sp, "%lu: %s: %u/%u\n", ep->l_cur,
 	    type == LOG_CURSOR_INIT ? "log_cursor_init" : "log_cursor_end",
 	    sp->lno, sp->cno);
 #endif
-	/* Reset high water mark. */
-	ep->l_high = ++ep->l_cur;
-
 	return (0);
 }
 
@@ -215,11 +559,9 @@ log_cursor1(SCR *sp, int type)
 int
 log_line(SCR *sp, recno_t lno, u_int action)
 {
-	DBT data, key;
 	EXF *ep;
 	size_t len;
 	CHAR_T *lp;
-	recno_t lcur;
 
 	ep = sp->ep;
 	if (F_ISSET(ep, F_NOLOG))
@@ -233,6 +575,14 @@ log_line(SCR *sp, recno_t lno, u_int action)
 	 */
 	F_CLR(ep, F_UNDO);
 
+	/*
+	 * Check the saved history before the first record is logged.  Lines
+	 * that are appended or inserted are logged after they're added.
+	 */
+	if (log_verify(sp, action == LOG_LINE_APPEND ||
+	    action == LOG_LINE_INSERT ? lno : 0, 1))
+		return (1);
+
 	/* Put out one initial cursor record per set of changes. */
 	if (ep->l_cursor.lno != OOBLNO) {
 		if (log_cursor1(sp, LOG_CURSOR_INIT))
@@ -244,7 +594,8 @@ log_line(SCR *sp, recno_t lno, u_int action)
 	 * Put out the changes.  If it's a LOG_LINE_RESET_B call, it's a
 	 * special case, avoid the caches.  Also, if it fails and it's
 	 * line 1, it just means that the user started with an empty file,
-	 * so fake an empty length line.
+	 * so fake an empty length line.  The line is saved, and logged
+	 * with the LOG_LINE_RESET_F call that follows it.
 	 */
 	if (action == LOG_LINE_RESET_B) {
 		if (db_get(sp, lno, DBG_NOCACHE, &lp, &len)) {
@@ -255,23 +606,72 @@ log_line(SCR *sp, recno_t lno, u_int action)
 			len = 0;
 			lp = L("");
 		}
-	} else
-		if (db_get(sp, lno, DBG_FATAL, &lp, &len))
+		BINC_RETW(sp, ep->l_bp, ep->l_blen, len);
+		MEMMOVE(ep->l_bp, lp, len);
+		ep->l_bcnt = len;
+		return (0);
+	}
+	if (db_get(sp, lno, DBG_FATAL, &lp, &len))
+		return (1);
+	if (action == LOG_LINE_RESET_F)
+		return (log_reset(sp, lno, lp, len));
+	return (log_line1(sp, lno, action, lp, len));
+}
+
+/*
+ * log_lines --
+ *	Log the append of cnt lines, taken from the TEXT list starting at
+ *	tp, as lines lno and following.  The lines are logged from the list
+ *	rather than re-read from the file.
+ *
+ * PUBLIC: int log_lines(SCR *, recno_t, TEXT *, recno_t);
+ */
+int
+log_lines(SCR *sp, recno_t lno, TEXT *tp, recno_t cnt)
+{
+	EXF *ep;
+
+	ep = sp->ep;
+	if (F_ISSET(ep, F_NOLOG))
+		return (0);
+
+	/* See log_line. */
+	F_CLR(ep, F_UNDO);
+	if (log_verify(sp, lno, cnt))
+		return (1);
+	if (ep->l_cursor.lno != OOBLNO) {
+		if (log_cursor1(sp, LOG_CURSOR_INIT))
 			return (1);
+		ep->l_cursor.lno = OOBLNO;
+	}
+
+	for (; cnt > 0; --cnt, ++lno, tp = TAILQ_NEXT(tp, q))
+		if (log_line1(sp, lno, LOG_LINE_APPEND, tp->lb, tp->len))
+			return (1);
+	return (0);
+}
+
+/*
+ * log_line1 --
+ *	Actually push a line record out.
+ */
+static int
+log_line1(SCR *sp, recno_t lno, u_int action, CHAR_T *lp, size_t len)
+{
+	EXF *ep;
+
+	ep = sp->ep;
+	if (log_flush(sp))
+		return (1);
+
 	BINC_RETC(sp,
 	    ep->l_lp, ep->l_len,
 	    len * sizeof(CHAR_T) + CHAR_T_OFFSET);
 	ep->l_lp[0] = action;
 	memmove(ep->l_lp + sizeof(u_char), &lno, sizeof(recno_t));
 	memmove(ep->l_lp + CHAR_T_OFFSET, lp, len * sizeof(CHAR_T));
-
-	lcur = ep->l_cur;
-	key.data = &lcur;
-	key.size = sizeof(recno_t);
-	data.data = ep->l_lp;
-	data.size = len * sizeof(CHAR_T) + CHAR_T_OFFSET;
-	if (ep->log->put(ep->log, &key, &data, 0) == -1)
-		LOG_ERR;
+	if (log_put(sp, len * sizeof(CHAR_T) + CHAR_T_OFFSET))
+		return (1);
 
 #if defined(DEBUG) && 0
 	switch (action) {
@@ -287,19 +687,647 @@ log_line(SCR *sp, recno_t lno, u_int action)
 		TRACE(sp, "%lu: log_line: insert: %lu {%u}\n",
 		    ep->l_cur, lno, len);
 		break;
-	case LOG_LINE_RESET_F:
-		TRACE(sp, "%lu: log_line: reset_f: %lu {%u}\n",
-		    ep->l_cur, lno, len);
-		break;
-	case LOG_LINE_RESET_B:
-		TRACE(sp, "%lu: log_line: reset_b: %lu {%u}\n",
-		    ep->l_cur, lno, len);
-		break;
 	}
 #endif
+	return (0);
+}
+
+/*
+ * log_reset --
+ *	Add a line reset, of the saved line to the line it was replaced
+ *	with, to the line reset group.
+ */
+static int
+log_reset(SCR *sp, recno_t lno, CHAR_T *lp, size_t len)
+{
+	EXF *ep;
+	log_reset_t lr;
+	size_t blen;
+	CHAR_T *bp;
+	char *p;
+
+	ep = sp->ep;
+	bp = ep->l_bp;
+	blen = ep->l_bcnt;
+
+	/* Count the characters the change didn't touch at each end. */
+	lr.lno = lno;
+	for (lr.pre = 0; lr.pre < len && lr.pre < blen &&
+	    lp[lr.pre] == bp[lr.pre]; ++lr.pre);
+	for (lr.suf = 0; lr.suf < len - lr.pre && lr.suf < blen - lr.pre &&
+	    lp[len - lr.suf - 1] == bp[blen - lr.suf - 1]; ++lr.suf);
+	lr.blen = blen - lr.pre - lr.suf;
+	lr.flen = len - lr.pre - lr.suf;
+
+	/*
+	 * Start a new group unless the line follows the group's lines, and
+	 * the group has room for it.
+	 */
+	if (ep->l_gcnt != 0 && (lno <= ep->l_glno ||
+	    ep->l_gcnt + RESET_LEN(&lr) > LOG_GROUPLEN) && log_flush(sp))
+		return (1);
+	if (ep->l_gcnt == 0) {
+		BINC_RETC(sp, ep->l_lp, ep->l_len, sizeof(u_char));
+		ep->l_lp[0] = LOG_LINE_GROUP;
+		ep->l_gcnt = sizeof(u_char);
+	}
+
+	BINC_RETC(sp, ep->l_lp, ep->l_len, ep->l_gcnt + RESET_LEN(&lr));
+	p = ep->l_lp + ep->l_gcnt;
+	memmove(p, &lr, sizeof(log_reset_t));
+	p += sizeof(log_reset_t);
+	memmove(p, bp + lr.pre, lr.blen * sizeof(CHAR_T));
+	p += lr.blen * sizeof(CHAR_T);
+	memmove(p, lp + lr.pre, lr.flen * sizeof(CHAR_T));
+	ep->l_gcnt += RESET_LEN(&lr);
+	ep->l_glno = lno;
+
+#if defined(DEBUG) && 0
+	TRACE(sp, "%lu: log_line: reset: %lu {%u/%u/%u/%u}\n",
+	    ep->l_cur, lno, lr.pre, lr.blen, lr.flen, lr.suf);
+#endif
+	return (0);
+}
+
+/*
+ * log_flush --
+ *	Put out the line reset group, if there is one.
+ */
+static int
+log_flush(SCR *sp)
+{
+	EXF *ep;
+	size_t size;
+
+	ep = sp->ep;
+	if ((size = ep->l_gcnt) == 0)
+		return (0);
+	ep->l_gcnt = 0;
+	return (log_put(sp, size));
+}
+
+/*
+ * log_put --
+ *	Put the record in the log buffer out, and reset the high water mark.
+ */
+static int
+log_put(SCR *sp, size_t size)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	size_t len;
+	char *p;
+
+	ep = sp->ep;
+
+	/* Discard any records that were undone. */
+	while (ep->l_nseg > 0 &&
+	    (segp = ep->l_seg + ep->l_nseg - 1)->off >= ep->l_cur) {
+		if (segp->bp != NULL) {
+			ep->l_mem -= segp->blen;
+			free(segp->bp);
+		}
+		--ep->l_nseg;
+	}
+	if (ep->l_nseg > 0)
+		segp->len = ep->l_cur - segp->off;
+	if (ep->l_cold > ep->l_nseg)
+		ep->l_cold = ep->l_nseg;
+	if (ep->l_linit >= ep->l_cur)
+		ep->l_linit = 0;
+
+	/* Start a new segment if the record doesn't fit in the last one. */
+	len = LOG_RECLEN(size);
+	if (ep->l_nseg == 0 ||
+	    segp->bp == NULL || segp->blen - segp->len < len) {
+		if (ep->l_nseg == ep->l_sseg) {
+			if ((segp = realloc(ep->l_seg, (ep->l_sseg + 64) *
+			    sizeof(LOGSEG))) == NULL)
+				LOG_ERR;
+			ep->l_seg = segp;
+			ep->l_sseg += 64;
+		}
+		segp = ep->l_seg + ep->l_nseg;
+		segp->blen = MAX(len, LOG_SEGSIZE);
+		if ((segp->bp = malloc(segp->blen)) == NULL)
+			LOG_ERR;
+		segp->off = ep->l_cur;
+		segp->len = 0;
+		++ep->l_nseg;
+		ep->l_mem += segp->blen;
+	}
+
+	p = segp->bp + segp->len;
+	memmove(p, &size, sizeof(size_t));
+	memmove(p + sizeof(size_t), ep->l_lp, size);
+	memmove(p + len - sizeof(size_t), &size, sizeof(size_t));
+	segp->len += len;
+	segp->spilled = segp->saved = 0;
+
 	/* Reset high water mark. */
-	ep->l_high = ++ep->l_cur;
+	ep->l_high = ep->l_cur += len;
+
+	if (log_evict(sp) || log_spill(sp, ep->l_nseg))
+		LOG_ERR;
+	return (0);
+}
+
+/*
+ * log_prev --
+ *	Back the log up over a record, and return it.
+ */
+static int
+log_prev(SCR *sp, u_char **pp, size_t *sizep)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	size_t off, size;
+	char *p;
+
+	ep = sp->ep;
+	if ((segp = log_seg(sp, ep->l_cur - 1)) == NULL)
+		return (1);
+	off = ep->l_cur - segp->off;
+	if (off < sizeof(size_t))
+		return (log_bad(sp));
+	memmove(&size, segp->bp + off - sizeof(size_t), sizeof(size_t));
+	if (size > off || LOG_RECLEN(size) > off ||
+	    ep->l_cur - LOG_RECLEN(size) < ep->l_base)
+		return (log_bad(sp));
+	p = segp->bp + off - LOG_RECLEN(size);
+	if (log_check(sp, p, LOG_RECLEN(size), sizep))
+		return (1);
+	ep->l_cur -= LOG_RECLEN(size);
+	*pp = (u_char *)p + sizeof(size_t);
+	return (0);
+}
+
+/*
+ * log_next --
+ *	Move the log forward over a record, and return the one after it.
+ */
+static int
+log_next(SCR *sp, u_char **pp, size_t *sizep)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	char *p;
+
+	ep = sp->ep;
+	if ((segp = log_seg(sp, ep->l_cur)) == NULL)
+		return (1);
+	if (log_check(sp, segp->bp + (ep->l_cur - segp->off),
+	    segp->off + segp->len - ep->l_cur, sizep))
+		return (1);
+	ep->l_cur += LOG_RECLEN(*sizep);
+	if ((segp = log_seg(sp, ep->l_cur)) == NULL)
+		return (1);
+	p = segp->bp + (ep->l_cur - segp->off);
+	if (log_check(sp, p, segp->off + segp->len - ep->l_cur, sizep))
+		return (1);
+	*pp = (u_char *)p + sizeof(size_t);
+	return (0);
+}
+
+/*
+ * log_check --
+ *	Check the record at the start of a buffer, which has len bytes to
+ *	the end of its segment, and return its length.  The log's records
+ *	are only checked because they may have been read from an undo file.
+ */
+static int
+log_check(SCR *sp, char *bp, size_t len, size_t *sizep)
+{
+	log_reset_t lr;
+	size_t n, size;
+	u_char *end, *p, *t;
 
+	if (len < 2 * sizeof(size_t))
+		return (log_bad(sp));
+	memmove(&size, bp, sizeof(size_t));
+	if (size == 0 ||
+	    size > len - 2 * sizeof(size_t) || LOG_RECLEN(size) > len ||
+	    memcmp(bp + LOG_RECLEN(size) - sizeof(size_t), &size,
+	    sizeof(size_t)))
+		return (log_bad(sp));
+
+	p = (u_char *)bp + sizeof(size_t);
+	end = p + size;
+	switch (*p) {
+	case LOG_CURSOR_INIT:
+	case LOG_CURSOR_END:
+		if (size != sizeof(u_char) + sizeof(MARK))
+			return (log_bad(sp));
+		break;
+	case LOG_LINE_APPEND:
+	case LOG_LINE_DELETE:
+	case LOG_LINE_INSERT:
+		if (size < CHAR_T_OFFSET ||
+		    (size - CHAR_T_OFFSET) % sizeof(CHAR_T) != 0)
+			return (log_bad(sp));
+		break;
+	case LOG_LINE_GROUP:
+		for (t = p + sizeof(u_char); t < end; t += RESET_LEN(&lr)) {
+			if ((size_t)(end - t) < sizeof(log_reset_t))
+				return (log_bad(sp));
+			memmove(&lr, t, sizeof(log_reset_t));
+			n = (end - t - sizeof(log_reset_t)) / sizeof(CHAR_T);
+			if (lr.blen > n || lr.flen > n - lr.blen)
+				return (log_bad(sp));
+		}
+		break;
+	case LOG_MARK:
+		if (size != sizeof(u_char) + sizeof(LMARK))
+			return (log_bad(sp));
+		break;
+	default:
+		return (log_bad(sp));
+	}
+	*sizep = size;
+	return (0);
+}
+
+/*
+ * log_bad --
+ *	Complain about a corrupted log, the caller restarts it.
+ */
+static int
+log_bad(SCR *sp)
+{
+	msgq(sp, M_ERR, "335|The saved undo history is corrupted");
+	errno = EIO;
+	return (1);
+}
+
+/*
+ * log_seg --
+ *	Return the segment holding a log offset, reading it in if it was
+ *	spilled.
+ */
+static LOGSEG *
+log_seg(SCR *sp, size_t off)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	size_t base, cnt;
+
+	ep = sp->ep;
+	if (off < ep->l_base || off >= ep->l_high) {
+		errno = EINVAL;
+		return (NULL);
+	}
+	for (base = 0, cnt = ep->l_nseg; cnt > 1;)
+		if (ep->l_seg[base + cnt / 2].off <= off) {
+			base += cnt / 2;
+			cnt -= cnt / 2;
+		} else
+			cnt /= 2;
+	segp = ep->l_seg + base;
+	if (segp->bp != NULL)
+		return (segp);
+
+	if ((segp->bp = malloc(segp->len)) == NULL)
+		return (NULL);
+	if (pread(segp->spilled ? ep->l_fd : ep->l_ufd, segp->bp,
+	    segp->len, LOG_SOFF(ep, segp)) != (ssize_t)segp->len) {
+		free(segp->bp);
+		segp->bp = NULL;
+		return (NULL);
+	}
+	segp->blen = segp->len;
+	ep->l_mem += segp->blen;
+	if (ep->l_cold > base)
+		ep->l_cold = base;
+	return (log_spill(sp, base) ? NULL : segp);
+}
+
+/*
+ * log_spill --
+ *	Write segments out to the spill file, oldest first, until the log
+ *	fits in the undocache limit.  The last segment, which is being
+ *	appended to, and the segment being read are kept.
+ */
+static int
+log_spill(SCR *sp, size_t keep)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	u_long max;
+	size_t i;
+	char *tname;
+
+	ep = sp->ep;
+	if ((max = O_VAL(sp, O_UNDOCACHE)) == 0)
+		return (0);
+	for (i = ep->l_cold;
+	    ep->l_mem / 1024 > max && i + 1 < ep->l_nseg; ++i) {
+		if (i == keep)
+			continue;
+		segp = ep->l_seg + i;
+		if (segp->bp != NULL) {
+			if (!segp->spilled && !segp->saved) {
+				if (ep->l_fd == -1) {
+					if ((tname = join(O_STR(sp, O_TMPDIR),
+					    "vi.XXXXXXXXXX")) == NULL)
+						return (1);
+					ep->l_fd = mkstemp(tname);
+					if (ep->l_fd != -1)
+						(void)unlink(tname);
+					free(tname);
+					if (ep->l_fd == -1)
+						return (1);
+				}
+				if (pwrite(ep->l_fd, segp->bp, segp->len,
+				    LOG_FOFF(segp->off)) != (ssize_t)segp->len)
+					return (1);
+				segp->spilled = 1;
+			}
+			ep->l_mem -= segp->blen;
+			free(segp->bp);
+			segp->bp = NULL;
+		}
+		if (i == ep->l_cold)
+			++ep->l_cold;
+	}
+	return (0);
+}
+
+/*
+ * log_evict --
+ *	Discard the oldest changes while the log is larger than the undolimit
+ *	option's kilobytes.  The log is restarted at the first change that
+ *	starts where the rest of the log fits, and the segments before it
+ *	are freed.
+ */
+static int
+log_evict(SCR *sp)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	size_t base, i, limit, size;
+	char *p;
+
+	ep = sp->ep;
+	limit = O_VAL(sp, O_UNDOLIMIT) * 1024;
+	if (limit == 0 || ep->l_high - ep->l_base <= limit)
+		return (0);
+
+	/*
+	 * If the last change starts before the rest of the log fits, it's
+	 * the only change left, and it's kept.  Otherwise, walk the records
+	 * from the start of the segment where the rest fits to a change.
+	 */
+	if (ep->l_linit < ep->l_high - limit || ep->l_linit > ep->l_cur)
+		return (0);
+	if ((segp = log_seg(sp, ep->l_high - limit)) == NULL)
+		return (1);
+	for (base = MAX(segp->off, ep->l_base);; base += LOG_RECLEN(size)) {
+		if ((segp = log_seg(sp, base)) == NULL)
+			return (1);
+		p = segp->bp + (base - segp->off);
+		if (log_check(sp, p, segp->off + segp->len - base, &size))
+			return (1);
+		if (base >= ep->l_high - limit &&
+		    p[sizeof(size_t)] == LOG_CURSOR_INIT)
+			break;
+	}
+
+	/* Free the segments before the new start of the log. */
+	for (i = 0; i < ep->l_nseg &&
+	    ep->l_seg[i].off + ep->l_seg[i].len <= base; ++i)
+		if ((segp = ep->l_seg + i)->bp != NULL) {
+			ep->l_mem -= segp->blen;
+			free(segp->bp);
+		}
+	memmove(ep->l_seg, ep->l_seg + i, (ep->l_nseg - i) * sizeof(LOGSEG));
+	ep->l_nseg -= i;
+	ep->l_cold = ep->l_cold > i ? ep->l_cold - i : 0;
+
+	/* History saved in the undo file, and not yet read, is older. */
+	free(ep->l_hdr);
+	ep->l_hdr = NULL;
+
+	++ep->l_evicts;
+	ep->l_evbytes += base - ep->l_base;
+	ep->l_base = base;
+	return (0);
+}
+
+/*
+ * log_load --
+ *	Add the history saved in the undo file to the start of the log.  The
+ *	changes that had been undone when it was saved are only kept if the
+ *	log is still empty.  If the log is to be rolled over the history,
+ *	check that the text is the text it was saved with.
+ */
+static int
+log_load(SCR *sp, int verify)
+{
+	EXF *ep;
+	LOGHDR *hp;
+	LOGSEG *segp;
+	u_int64_t hash;
+	size_t cnt, high, i, off, *tp;
+
+	ep = sp->ep;
+	hp = ep->l_hdr;
+	ep->l_hdr = NULL;
+	tp = NULL;
+
+	if (verify) {
+		if (log_hash(sp, 0, 0, &hash))
+			goto err;
+		if (hash != hp->hash) {
+			msgq(sp, M_ERR,
+			    "334|The saved undo history doesn't match the file");
+			goto err;
+		}
+	}
+
+	high = ep->l_high == ep->l_base ? hp->high : hp->cur;
+	if (hp->nseg == 0 || high == 0)
+		goto done;
+	if (hp->nseg > SIZE_MAX / (2 * sizeof(size_t))) {
+		(void)log_bad(sp);
+		goto err;
+	}
+	if ((tp = malloc(hp->nseg * 2 * sizeof(size_t))) == NULL)
+		goto serr;
+	if (pread(ep->l_ufd, tp, hp->nseg * 2 * sizeof(size_t),
+	    LOG_FOFF(hp->high - hp->start)) !=
+	    (ssize_t)(hp->nseg * 2 * sizeof(size_t)))
+		goto serr;
+
+	/* The segments have to run, without gaps, to the end. */
+	for (cnt = 0, off = tp[0]; cnt < hp->nseg && off < high; ++cnt) {
+		if (tp[2 * cnt] != off ||
+		    tp[2 * cnt + 1] == 0 || tp[2 * cnt + 1] > hp->high - off)
+			break;
+		off += tp[2 * cnt + 1];
+	}
+	if (off < high || off > hp->high ||
+	    tp[0] != hp->start || hp->base < tp[0]) {
+		(void)log_bad(sp);
+		goto err;
+	}
+	if (cnt == 0)
+		goto done;
+
+	if (ep->l_nseg + cnt > ep->l_sseg) {
+		if ((segp = realloc(ep->l_seg,
+		    (ep->l_nseg + cnt + 64) * sizeof(LOGSEG))) == NULL)
+			goto serr;
+		ep->l_seg = segp;
+		ep->l_sseg = ep->l_nseg + cnt + 64;
+	}
+	memmove(ep->l_seg + cnt, ep->l_seg, ep->l_nseg * sizeof(LOGSEG));
+	for (i = 0; i < cnt; ++i) {
+		segp = ep->l_seg + i;
+		segp->bp = NULL;
+		segp->blen = 0;
+		segp->off = tp[2 * i];
+		segp->len = MIN(tp[2 * i + 1], high - segp->off);
+		segp->spilled = 0;
+		segp->saved = 1;
+	}
+	ep->l_nseg += cnt;
+	ep->l_cold += cnt;
+	ep->l_base = hp->base;
+	if (ep->l_high < high)
+		ep->l_high = high;
+
+done:	free(tp);
+	free(hp);
+	return (0);
+
+serr:	msgq(sp, M_SYSERR, NULL);
+err:	free(tp);
+	free(hp);
+	return (1);
+}
+
+/*
+ * log_path --
+ *	Return the path of the undo file, which is named for a hash of the
+ *	file's path, and the file's path.
+ */
+static char *
+log_path(SCR *sp, char **keyp)
+{
+	u_int64_t h;
+	char *key, *p, name[32];
+
+	if (opts_empty(sp, O_RECDIR, 1) ||
+	    (key = realpath(sp->frp->name, NULL)) == NULL)
+		return (NULL);
+	for (h = LOG_FNV_INIT, p = key; *p != '\0'; ++p)
+		h = LOG_FNV(h, *p);
+	(void)snprintf(name,
+	    sizeof(name), "undo.%016llx", (unsigned long long)h);
+	if ((p = join(O_STR(sp, O_RECDIR), name)) == NULL) {
+		free(key);
+		return (NULL);
+	}
+	*keyp = key;
+	return (p);
+}
+
+/*
+ * log_hash --
+ *	Hash the text of the file, for its undo file, leaving out the cnt
+ *	lines starting at skip.
+ */
+static int
+log_hash(SCR *sp, recno_t skip, recno_t cnt, u_int64_t *hp)
+{
+	recno_t lno, last, n, stop;
+	u_int64_t h;
+	size_t len;
+	char *p;
+
+	if (db_last(sp, &last))
+		return (1);
+	for (h = LOG_FNV_INIT, lno = 1; lno <= last; lno += n) {
+		if (lno == skip && cnt != 0) {
+			n = cnt;
+			continue;
+		}
+		stop = lno < skip ? skip : last + 1;
+		if (db_rspan(sp, lno, stop - lno, &p, &len, &n))
+			return (1);
+		if (n == 0) {
+			if (db_rget(sp, lno, &p, &len))
+				return (1);
+			n = 1;
+			for (; len > 0; --len)
+				h = LOG_FNV(h, *p++);
+			h = LOG_FNV(h, '\n');
+		} else
+			for (; len > 0; --len)
+				h = LOG_FNV(h, *p++);
+	}
+	*hp = h;
+	return (0);
+}
+
+/*
+ * log_stats --
+ *	Count the changes and records in the log, and find the largest
+ *	change.
+ *
+ * PUBLIC: int log_stats(SCR *, u_long *, u_long *, size_t *);
+ */
+int
+log_stats(SCR *sp, u_long *changesp, u_long *recordsp, size_t *largestp)
+{
+	EXF *ep;
+	LOGSEG *segp;
+	size_t i, init, off, size;
+	char *p;
+
+	ep = sp->ep;
+	*changesp = *recordsp = 0;
+	*largestp = 0;
+	init = ep->l_base;
+	for (i = 0; i < ep->l_nseg; ++i) {
+		segp = ep->l_seg + i;
+
+		/* Spilled segments are read without keeping them. */
+		if ((p = segp->bp) == NULL) {
+			if ((p = malloc(segp->len)) == NULL) {
+				msgq(sp, M_SYSERR, NULL);
+				return (1);
+			}
+			if (pread(segp->spilled ? ep->l_fd : ep->l_ufd, p,
+			    segp->len, LOG_SOFF(ep, segp)) !=
+			    (ssize_t)segp->len) {
+				msgq(sp, M_SYSERR, NULL);
+				free(p);
+				return (1);
+			}
+		}
+		for (off = MAX(segp->off, ep->l_base);
+		    off < segp->off + segp->len; off += LOG_RECLEN(size)) {
+			if (log_check(sp, p + (off - segp->off),
+			    segp->off + segp->len - off, &size)) {
+				if (p != segp->bp)
+					free(p);
+				return (1);
+			}
+			++*recordsp;
+			if (p[off - segp->off + sizeof(size_t)] !=
+			    LOG_CURSOR_INIT)
+				continue;
+			if (*changesp != 0 && off - init > *largestp)
+				*largestp = off - init;
+			++*changesp;
+			init = off;
+		}
+		if (p != segp->bp)
+			free(p);
+	}
+	if (*changesp != 0 && ep->l_high - init > *largestp)
+		*largestp = ep->l_high - init;
 	return (0);
 }
 
@@ -315,12 +1343,13 @@ log_line(SCR *sp, recno_t lno, u_int action)
 int
 log_mark(SCR *sp, LMARK *lmp)
 {
-	DBT data, key;
 	EXF *ep;
 
 	ep = sp->ep;
 	if (F_ISSET(ep, F_NOLOG))
 		return (0);
+	if (log_verify(sp, 0, 0))
+		return (1);
 
 	/* Put out one initial cursor record per set of changes. */
 	if (ep->l_cursor.lno != OOBLNO) {
@@ -328,25 +1357,20 @@ log_mark(SCR *sp, LMARK *lmp)
 			return (1);
 		ep->l_cursor.lno = OOBLNO;
 	}
+	if (log_flush(sp))
+		return (1);
 
 	BINC_RETC(sp, ep->l_lp,
 	    ep->l_len, sizeof(u_char) + sizeof(LMARK));
 	ep->l_lp[0] = LOG_MARK;
 	memmove(ep->l_lp + sizeof(u_char), lmp, sizeof(LMARK));
-
-	key.data = &ep->l_cur;
-	key.size = sizeof(recno_t);
-	data.data = ep->l_lp;
-	data.size = sizeof(u_char) + sizeof(LMARK);
-	if (ep->log->put(ep->log, &key, &data, 0) == -1)
-		LOG_ERR;
+	if (log_put(sp, sizeof(u_char) + sizeof(LMARK)))
+		return (1);
 
 #if defined(DEBUG) && 0
 	TRACE(sp, "%lu: mark %c: %lu/%u\n",
 	    ep->l_cur, lmp->name, lmp->lno, lmp->cno);
 #endif
-	/* Reset high water mark. */
-	ep->l_high = ++ep->l_cur;
 	return (0);
 }
 
@@ -359,11 +1383,11 @@ log_mark(SCR *sp, LMARK *lmp)
 int
 log_backward(SCR *sp, MARK *rp)
 {
-	DBT key, data;
 	EXF *ep;
 	LMARK lm;
 	MARK m;
-	recno_t lno;
+	recno_t cnt, lno, tlno;
+	size_t off, size;
 	int didop;
 	u_char *p;
 
@@ -374,23 +1398,24 @@ log_backward(SCR *sp, MARK *rp)
 		return (1);
 	}
 
-	if (ep->l_cur == 1) {
+	if (log_flush(sp))
+		return (1);
+	if (ep->l_cur == ep->l_base && ep->l_hdr != NULL && log_load(sp, 1))
+		return (1);
+	if (ep->l_cur == ep->l_base) {
 		msgq(sp, M_BERR, "011|No changes to undo");
 		return (1);
 	}
 
 	F_SET(ep, F_NOLOG);		/* Turn off logging. */
 
-	key.data = &ep->l_cur;		/* Initialize db request. */
-	key.size = sizeof(recno_t);
 	for (didop = 0;;) {
-		--ep->l_cur;
-		if (ep->log->get(ep->log, &key, &data, 0))
+		if (log_prev(sp, &p, &size))
 			LOG_ERR;
 #if defined(DEBUG) && 0
-		log_trace(sp, "log_backward", ep->l_cur, data.data);
+		log_trace(sp, "log_backward", ep->l_cur, p);
 #endif
-		switch (*(p = (u_char *)data.data)) {
+		switch (*p) {
 		case LOG_CURSOR_INIT:
 			if (didop) {
 				memmove(rp, p + sizeof(u_char), sizeof(MARK));
@@ -404,30 +1429,41 @@ log_backward(SCR *sp, MARK *rp)
 		case LOG_LINE_INSERT:
 			didop = 1;
 			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-			if (db_delete(sp, lno))
+
+			/*
+			 * Gather the lines added by the records before this
+			 * one into a single deletion, while each was added
+			 * just before, or at the start of, the lines so far.
+			 */
+			for (cnt = 1;; ++cnt) {
+				off = ep->l_cur;
+				if (log_prev(sp, &p, &size))
+					LOG_ERR;
+				if (*p != LOG_LINE_APPEND && *p != LOG_LINE_INSERT)
+					break;
+				memmove(&tlno, p + sizeof(u_char), sizeof(recno_t));
+				if (tlno == lno - 1)
+					lno = tlno;
+				else if (tlno != lno)
+					break;
+			}
+			ep->l_cur = off;
+			if (db_delete_lines(sp, lno, cnt))
 				goto err;
-			++sp->rptlines[L_DELETED];
+			sp->rptlines[L_DELETED] += cnt;
 			break;
 		case LOG_LINE_DELETE:
 			didop = 1;
 			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
 			if (apply_with(db_insert, sp, lno,
-				p + CHAR_T_OFFSET, data.size - CHAR_T_OFFSET))
+				p + CHAR_T_OFFSET, size - CHAR_T_OFFSET))
 				goto err;
 			++sp->rptlines[L_ADDED];
 			break;
-		case LOG_LINE_RESET_F:
-			break;
-		case LOG_LINE_RESET_B:
+		case LOG_LINE_GROUP:
 			didop = 1;
-			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-			if (apply_with(db_set, sp, lno,
-				p + CHAR_T_OFFSET, data.size - CHAR_T_OFFSET))
+			if (apply_group(sp, p, size, 0))
 				goto err;
-			if (sp->rptlchange != lno) {
-				sp->rptlchange = lno;
-				++sp->rptlines[L_CHANGED];
-			}
 			break;
 		case LOG_MARK:
 			didop = 1;
@@ -461,12 +1497,12 @@ err:	F_CLR(ep, F_NOLOG);
 int
 log_setline(SCR *sp)
 {
-	DBT key, data;
 	EXF *ep;
 	LMARK lm;
 	MARK m;
-	recno_t lno;
-	u_char *p;
+	log_reset_t lr;
+	size_t len, size;
+	u_char *p, *t;
 
 	ep = sp->ep;
 	if (F_ISSET(ep, F_NOLOG)) {
@@ -475,24 +1511,23 @@ log_setline(SCR *sp)
 		return (1);
 	}
 
-	if (ep->l_cur == 1)
+	if (log_flush(sp))
+		return (1);
+	if (ep->l_cur == ep->l_base)
 		return (1);
 
 	F_SET(ep, F_NOLOG);		/* Turn off logging. */
 
-	key.data = &ep->l_cur;		/* Initialize db request. */
-	key.size = sizeof(recno_t);
 	for (;;) {
-		--ep->l_cur;
-		if (ep->log->get(ep->log, &key, &data, 0))
+		if (log_prev(sp, &p, &size))
 			LOG_ERR;
 #if defined(DEBUG) && 0
-		log_trace(sp, "log_setline", ep->l_cur, data.data);
+		log_trace(sp, "log_setline", ep->l_cur, p);
 #endif
-		switch (*(p = (u_char *)data.data)) {
+		switch (*p) {
 		case LOG_CURSOR_INIT:
 			memmove(&m, p + sizeof(u_char), sizeof(MARK));
-			if (m.lno != sp->lno || ep->l_cur == 1) {
+			if (m.lno != sp->lno || ep->l_cur == ep->l_base) {
 				F_CLR(ep, F_NOLOG);
 				return (0);
 			}
@@ -500,7 +1535,7 @@ log_setline(SCR *sp)
 		case LOG_CURSOR_END:
 			memmove(&m, p + sizeof(u_char), sizeof(MARK));
 			if (m.lno != sp->lno) {
-				++ep->l_cur;
+				ep->l_cur += LOG_RECLEN(size);
 				F_CLR(ep, F_NOLOG);
 				return (0);
 			}
@@ -508,18 +1543,31 @@ log_setline(SCR *sp)
 		case LOG_LINE_APPEND:
 		case LOG_LINE_INSERT:
 		case LOG_LINE_DELETE:
-		case LOG_LINE_RESET_F:
 			break;
-		case LOG_LINE_RESET_B:
-			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-			if (lno == sp->lno &&
-				apply_with(db_set, sp, lno,
-				p + CHAR_T_OFFSET, data.size - CHAR_T_OFFSET))
-				goto err;
-			if (sp->rptlchange != lno) {
-				sp->rptlchange = lno;
-				++sp->rptlines[L_CHANGED];
+		case LOG_LINE_GROUP:
+			for (t = p + sizeof(u_char);
+			    t < p + size; t += RESET_LEN(&lr)) {
+				memmove(&lr, t, sizeof(log_reset_t));
+				if (lr.lno == sp->lno) {
+					switch (log_image(sp, &lr,
+					    t + sizeof(log_reset_t), 0, &len)) {
+					case -1:
+						break;
+					case 0:
+						if (db_set(sp,
+						    lr.lno, ep->l_bp, len))
+							goto err;
+						break;
+					default:
+						goto err;
+					}
+				}
+				if (sp->rptlchange != lr.lno) {
+					sp->rptlchange = lr.lno;
+					++sp->rptlines[L_CHANGED];
+				}
 			}
+			break;
 		case LOG_MARK:
 			memmove(&lm, p + sizeof(u_char), sizeof(LMARK));
 			m.lno = lm.lno;
@@ -545,11 +1593,11 @@ err:	F_CLR(ep, F_NOLOG);
 int
 log_forward(SCR *sp, MARK *rp)
 {
-	DBT key, data;
 	EXF *ep;
 	LMARK lm;
 	MARK m;
-	recno_t lno;
+	recno_t cnt, lno, tlno;
+	size_t off, size;
 	int didop;
 	u_char *p;
 
@@ -560,6 +1608,11 @@ log_forward(SCR *sp, MARK *rp)
 		return (1);
 	}
 
+	if (log_flush(sp))
+		return (1);
+	if (ep->l_cur == ep->l_base &&
+	    ep->l_high == ep->l_base && ep->l_hdr != NULL && log_load(sp, 1))
+		return (1);
 	if (ep->l_cur == ep->l_high) {
 		msgq(sp, M_BERR, "014|No changes to re-do");
 		return (1);
@@ -567,19 +1620,16 @@ log_forward(SCR *sp, MARK *rp)
 
 	F_SET(ep, F_NOLOG);		/* Turn off logging. */
 
-	key.data = &ep->l_cur;		/* Initialize db request. */
-	key.size = sizeof(recno_t);
 	for (didop = 0;;) {
-		++ep->l_cur;
-		if (ep->log->get(ep->log, &key, &data, 0))
+		if (log_next(sp, &p, &size))
 			LOG_ERR;
 #if defined(DEBUG) && 0
-		log_trace(sp, "log_forward", ep->l_cur, data.data);
+		log_trace(sp, "log_forward", ep->l_cur, p);
 #endif
-		switch (*(p = (u_char *)data.data)) {
+		switch (*p) {
 		case LOG_CURSOR_END:
 			if (didop) {
-				++ep->l_cur;
+				ep->l_cur += LOG_RECLEN(size);
 				memmove(rp, p + sizeof(u_char), sizeof(MARK));
 				F_CLR(ep, F_NOLOG);
 				return (0);
@@ -592,29 +1642,40 @@ log_forward(SCR *sp, MARK *rp)
 			didop = 1;
 			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
 			if (apply_with(db_insert, sp, lno,
-				p + CHAR_T_OFFSET, data.size - CHAR_T_OFFSET))
+				p + CHAR_T_OFFSET, size - CHAR_T_OFFSET))
 				goto err;
 			++sp->rptlines[L_ADDED];
 			break;
 		case LOG_LINE_DELETE:
 			didop = 1;
 			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-			if (db_delete(sp, lno))
+
+			/*
+			 * Gather the lines deleted by the records after this
+			 * one into a single deletion, while each was deleted
+			 * just before, or at the start of, the lines so far.
+			 */
+			for (cnt = 1;; ++cnt) {
+				off = ep->l_cur;
+				if (log_next(sp, &p, &size))
+					LOG_ERR;
+				if (*p != LOG_LINE_DELETE)
+					break;
+				memmove(&tlno, p + sizeof(u_char), sizeof(recno_t));
+				if (tlno == lno - 1)
+					lno = tlno;
+				else if (tlno != lno)
+					break;
+			}
+			ep->l_cur = off;
+			if (db_delete_lines(sp, lno, cnt))
 				goto err;
-			++sp->rptlines[L_DELETED];
-			break;
-		case LOG_LINE_RESET_B:
+			sp->rptlines[L_DELETED] += cnt;
 			break;
-		case LOG_LINE_RESET_F:
+		case LOG_LINE_GROUP:
 			didop = 1;
-			memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-			if (apply_with(db_set, sp, lno,
-				p + CHAR_T_OFFSET, data.size - CHAR_T_OFFSET))
+			if (apply_group(sp, p, size, 1))
 				goto err;
-			if (sp->rptlchange != lno) {
-				sp->rptlchange = lno;
-				++sp->rptlines[L_CHANGED];
-			}
 			break;
 		case LOG_MARK:
 			didop = 1;
@@ -633,6 +1694,34 @@ err:	F_CLR(ep, F_NOLOG);
 	return (1);
 }
 
+/*
+ * log_verify --
+ *	Check the history saved in the undo file against the text, before
+ *	the session's first record is logged, and drop it if the text isn't
+ *	the text it was saved with.  The cnt lines starting at lno are being
+ *	logged as added, and aren't part of that text.
+ */
+static int
+log_verify(SCR *sp, recno_t lno, recno_t cnt)
+{
+	EXF *ep;
+	u_int64_t hash;
+	int rval;
+
+	ep = sp->ep;
+	if (ep->l_hdr == NULL || ep->l_high != ep->l_base)
+		return (0);
+	if ((rval = log_hash(sp, lno, cnt, &hash)) == 0) {
+		if (hash == ep->l_hdr->hash)
+			return (0);
+		msgq(sp, M_ERR,
+		    "334|The saved undo history doesn't match the file");
+	}
+	free(ep->l_hdr);
+	ep->l_hdr = NULL;
+	return (rval);
+}
+
 /*
  * log_err --
  *	Try and restart the log on failure, i.e. if we run out of memory.
@@ -644,14 +1733,14 @@ log_err(SCR *sp, char *file, int line)
 
 	msgq(sp, M_SYSERR, "015|%s/%d: log put error", basename(file), line);
 	ep = sp->ep;
-	(void)ep->log->close(ep->log);
+	(void)log_end(sp, ep);
 	if (!log_init(sp, ep))
 		msgq(sp, M_ERR, "267|Log restarted");
 }
 
 #if defined(DEBUG) && 0
 static void
-log_trace(SCR *sp, char *msg, recno_t rno, u_char *p)
+log_trace(SCR *sp, char *msg, size_t rno, u_char *p)
 {
 	LMARK lm;
 	MARK m;
@@ -678,13 +1767,9 @@ log_trace(SCR *sp, char *msg, recno_t rno, u_char *p)
 		memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
 		TRACE(sp, "%lu: %s:  DELETE: %lu\n", rno, msg, lno);
 		break;
-	case LOG_LINE_RESET_F:
-		memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-		TRACE(sp, "%lu: %s: RESET_F: %lu\n", rno, msg, lno);
-		break;
-	case LOG_LINE_RESET_B:
+	case LOG_LINE_GROUP:
 		memmove(&lno, p + sizeof(u_char), sizeof(recno_t));
-		TRACE(sp, "%lu: %s: RESET_B: %lu\n", rno, msg, lno);
+		TRACE(sp, "%lu: %s:   GROUP: %lu\n", rno, msg, lno);
 		break;
 	case LOG_MARK:
 		memmove(&lm, p + sizeof(u_char), sizeof(LMARK));
@@ -697,6 +1782,106 @@ log_trace(SCR *sp, char *msg, recno_t rno, u_char *p)
 }
 #endif
 
+/*
+ * log_image --
+ *	Build the line a line reset in the log resets the line to, before
+ *	or after the change, in the log's line buffer.  Return -1 if the
+ *	line is already that image.
+ */
+static int
+log_image(SCR *sp, log_reset_t *lrp, u_char *p, int after, size_t *lenp)
+{
+	EXF *ep;
+	size_t len, mlen, olen;
+	CHAR_T *lp;
+
+	ep = sp->ep;
+	if (after) {
+		p += lrp->blen * sizeof(CHAR_T);
+		mlen = lrp->flen;
+		olen = lrp->blen;
+	} else {
+		mlen = lrp->blen;
+		olen = lrp->flen;
+	}
+
+	if (db_get(sp, lrp->lno, DBG_FATAL, &lp, &len))
+		return (1);
+
+	/*
+	 * The unchanged characters are part of either image of the line.
+	 * Build the line in the log's line buffer, it's not in use, as
+	 * logging is off.
+	 */
+	if (lrp->pre > len || lrp->suf > len - lrp->pre)
+		goto bad;
+	*lenp = lrp->pre + mlen + lrp->suf;
+	BINC_RETW(sp, ep->l_bp, ep->l_blen, *lenp);
+	memmove(ep->l_bp + lrp->pre, p, mlen * sizeof(CHAR_T));
+	if (len == *lenp && !MEMCMP(ep->l_bp + lrp->pre, lp + lrp->pre, mlen))
+		return (-1);
+	if (len - lrp->pre - lrp->suf != olen) {
+bad:		msgq(sp, M_ERR,
+		    "332|Line %lu doesn't match the log", (u_long)lrp->lno);
+		return (1);
+	}
+	MEMMOVE(ep->l_bp, lp, lrp->pre);
+	MEMMOVE(ep->l_bp + lrp->pre + mlen, lp + len - lrp->suf, lrp->suf);
+	return (0);
+}
+
+/*
+ * apply_group --
+ *	Apply a line reset group from the log to the file, as it was before
+ *	or after the change.  The lines are stored directly, so the cache and
+ *	the screens are only updated once.
+ */
+static int
+apply_group(SCR *sp, u_char *p, size_t size, int after)
+{
+	EXF *ep;
+	log_reset_t lr;
+	recno_t first, last;
+	size_t flen, len;
+	int rval;
+	char *fp;
+	u_char *t;
+
+	ep = sp->ep;
+	first = last = OOBLNO;
+	rval = 0;
+	for (t = p + sizeof(u_char); t < p + size; t += RESET_LEN(&lr)) {
+		memmove(&lr, t, sizeof(log_reset_t));
+		if (sp->rptlchange != lr.lno) {
+			sp->rptlchange = lr.lno;
+			++sp->rptlines[L_CHANGED];
+		}
+		switch (log_image(sp, &lr, t + sizeof(log_reset_t), after, &len)) {
+		case -1:
+			continue;
+		case 0:
+			break;
+		default:
+			rval = 1;
+			goto done;
+		}
+		INT2FILE(sp, ep->l_bp, len, fp, flen);
+		if (db_rset(sp, lr.lno, fp, flen) == -1) {
+			msgq(sp, M_SYSERR,
+			    "006|unable to store line %lu", (u_long)lr.lno);
+			rval = 1;
+			goto done;
+		}
+		if (first == OOBLNO)
+			first = lr.lno;
+		last = lr.lno;
+	}
+
+done:	if (first != OOBLNO && db_rset_end(sp, first, last - first + 1))
+		rval = 1;
+	return (rval);
+}
+
 /*
  * apply_with --
  *	Apply a realigned line from the log db to the file db.
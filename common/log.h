@@ -16,3 +16,46 @@
 #define	LOG_LINE_RESET_F	6
 #define	LOG_LINE_RESET_B	7
 #define	LOG_MARK		8
+#define	LOG_LINE_GROUP		9
+
+/*
+ * The log is an append-only arena of segments, addressed by byte offset.
+ * Each record is framed by its length at both ends, so the log can be
+ * walked in either direction, and no record spans segments.
+ */
+struct _logseg {
+	char	*bp;			/* Segment buffer, NULL if spilled. */
+	size_t	 blen;			/* Segment buffer length. */
+	size_t	 off;			/* Segment log offset. */
+	size_t	 len;			/* Segment log length. */
+	int	 spilled;		/* Segment is in the spill file. */
+	int	 saved;			/* Segment is in the undo file. */
+};
+#define	LOG_SEGSIZE	(64 * 1024)	/* Segment buffer length. */
+#define	LOG_GROUPLEN	(8 * 1024)	/* Line reset group length. */
+
+/*
+ * The undo file holds a header, followed by the log's records, at their
+ * log offsets less the offset of the first record in the file, followed
+ * by the table of the log's segments, as pairs of offsets and lengths, and
+ * the file's path.  It's named for a hash of the
+ * path, and the history it holds is only used for the file whose path,
+ * identity and text were saved with it.
+ */
+struct _loghdr {
+	u_int32_t magic;		/* LOG_MAGIC */
+	u_int32_t version;		/* LOG_VERSION */
+	u_int64_t hash;			/* Text hash. */
+	dev_t	 dev;			/* File device. */
+	ino_t	 ino;			/* File inode. */
+	off_t	 size;			/* File size. */
+	struct timespec mtim;		/* File last modification time. */
+	size_t	 start;			/* Log offset of the file's records. */
+	size_t	 base;			/* Log start offset. */
+	size_t	 cur;			/* Log current offset. */
+	size_t	 high;			/* Log end offset. */
+	size_t	 nseg;			/* Segment table entries. */
+	size_t	 plen;			/* Path length. */
+};
+#define	LOG_MAGIC	0x76697575	/* "viuu" */
+#define	LOG_VERSION	1
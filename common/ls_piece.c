@@ -0,0 +1,1090 @@
+/*-
+ * See the LICENSE file for redistribution information.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <bitstring.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/*
+ * The piece table line store.
+ *
+ * The original file is read into memory once, and never changed.  Lines
+ * that are added or replaced are copied into an append-only add buffer.
+ * The file is an ordered array of pieces, each of which describes a run
+ * of consecutive lines from one of the two buffers.  Changing a line
+ * never moves text, it splits the piece that holds the line and inserts
+ * a piece that references the new copy of the line.
+ *
+ * The original buffer is indexed by the offset of every PT_CKLINES'th
+ * line, plus the 32-bit offset of every line from its checkpoint, built
+ * by a single pass of the <newline> scanner when the store is opened, so
+ * the start of any line is found without scanning the file, and the
+ * index costs about four bytes a line.  The length of line N is the
+ * distance to the start of line N + 1, less the <newline>.
+ * The add buffer is indexed by an array of pointer/length pairs, and is
+ * a list of blocks that are never reallocated, so lines handed out by the
+ * get method from the add buffer remain valid for the life of the store.
+ *
+ * Each piece caches the file line number of its first line, and lookups
+ * are a binary search of the piece array, starting with a check of the
+ * last piece used, as most access is sequential.  Changes renumber the
+ * pieces following the change, which is cheap for the common case of a
+ * change sweeping down the file, as the unchanged remainder of the file
+ * is a single piece.
+ *
+ * Unless a snapshot is requested, regular files are mapped rather than
+ * read, and unmodified lines are returned directly from the mapping, so
+ * opening a file costs a single scan to count the lines, and neither the
+ * time nor the memory needed to start editing grows with the length of
+ * the lines.  The mapping is replaced by a private copy of the file if
+ * the file is about to be overwritten.
+ *
+ * Where threads are available, the line index of a large file is built
+ * by a separate thread, so the editor can display the start of the file
+ * while the rest of it is indexed.  Until the index is finished, the
+ * file is read only: lines are retrieved as soon as the index reaches
+ * them, under the index lock, and any other operation waits for the
+ * index to be finished.
+ */
+typedef struct {
+#define	PC_ORIG		0		/* Original file buffer. */
+#define	PC_ADD		1		/* Add buffer. */
+	int	 buf;			/* Buffer. */
+	size_t	 first;			/* First line index in the buffer. */
+	recno_t	 cnt;			/* Line count. */
+	recno_t	 lno;			/* File line number of first line. */
+} PIECE;
+
+typedef struct {
+	char	*p;			/* Line. */
+	size_t	 len;			/* Line length. */
+} ALINE;
+
+typedef struct {
+	int	 fd;			/* Original file descriptor. */
+	char	*bfname;		/* Backing (recovery) file name. */
+
+	char	*obuf;			/* Original file buffer. */
+	size_t	 olen;			/* Original file buffer length. */
+	size_t	 osize;			/* Original file buffer size. */
+	int	 oread;			/* If more of the file to read. */
+	size_t	 oend;			/* Sentinel line start. */
+	size_t	*ock;			/* Original line checkpoints. */
+	u_int32_t *orel;		/* Original line checkpoint offsets. */
+	size_t	 onlines;		/* Original line count. */
+	int	 mapped;		/* If obuf is mapped. */
+
+#define	PT_LOADING	1		/* Index is being built. */
+#define	PT_LFAILED	2		/* Index build failed. */
+	int	 loading;		/* Index load state. */
+#ifdef HAVE_PTHREAD
+	pthread_t	 lthread;	/* Index thread. */
+	pthread_mutex_t	 lmtx;		/* Index lock. */
+	pthread_cond_t	 lcond;		/* Index progress. */
+	int	 ldone;			/* Index thread finished. */
+	int	 lstop;			/* Index thread told to stop. */
+	int	 lerr;			/* Index thread errno. */
+#endif
+
+	ALINE	*add;			/* Add buffer line index. */
+	size_t	 nadd;			/* Add buffer line count. */
+	size_t	 addlen;		/* Add buffer line index length. */
+
+	char	**blk;			/* Add buffer blocks. */
+	size_t	 nblk;			/* Add buffer block count. */
+	size_t	 blklen;		/* Add buffer block array length. */
+	char	*cur;			/* Current add buffer block. */
+	size_t	 bused;			/* Bytes used in the current block. */
+
+	PIECE	*pc;			/* Pieces. */
+	size_t	 npc;			/* Piece count. */
+	size_t	 pclen;			/* Piece array length. */
+	size_t	 hint;			/* Last piece used. */
+
+	recno_t	 nlines;		/* Lines in the file. */
+} PTBL;
+
+#define	PT_BLKSIZE	(64 * 1024)	/* Add buffer block size. */
+#define	PT_CKLINES	64		/* Lines per line index checkpoint. */
+#define	PT_NOREL	UINT32_MAX	/* Checkpoint offset too large. */
+#define	PT_ASYNCLEN	(32 * 1024 * 1024)	/* Threaded index size. */
+#define	PT_READLEN	(1024 * 1024)	/* Threaded index read size. */
+#define	PT_LPUBLISH	(PT_CKLINES * 1024)	/* Index progress lines. */
+#define	PT_WAITALL	((recno_t)-1)	/* Wait for the whole index. */
+
+#ifdef HAVE_PTHREAD
+#define	PT_LOCK(pt) {							\
+	if ((pt)->loading)						\
+		(void)pthread_mutex_lock(&(pt)->lmtx);			\
+}
+#define	PT_UNLOCK(pt) {							\
+	if ((pt)->loading)						\
+		(void)pthread_mutex_unlock(&(pt)->lmtx);		\
+}
+#else
+#define	PT_LOCK(pt)
+#define	PT_UNLOCK(pt)
+#endif
+#define	PT_MAPCHUNK	(16 * 1024 * 1024)	/* Index scan release size. */
+
+static int	piece_close(LSTORE *);
+static int	piece_del(LSTORE *, recno_t, recno_t);
+static int	piece_fd(LSTORE *);
+static int	piece_get(LSTORE *, recno_t, char **, size_t *);
+static int	piece_iafter(LSTORE *, recno_t, char *, size_t);
+static int	piece_last(LSTORE *, recno_t *);
+static int	piece_loaded(LSTORE *, recno_t *);
+static int	piece_put(LSTORE *, recno_t, char *, size_t);
+static int	piece_snapshot(LSTORE *);
+static int	piece_span(LSTORE *, recno_t, recno_t, char **, size_t *, recno_t *);
+static int	piece_sync(LSTORE *);
+
+static int	pt_addline(PTBL *, char *, size_t, size_t *);
+static int	pt_find(PTBL *, recno_t, size_t *);
+static int	pt_grow(void *, size_t *, size_t, size_t);
+static int	pt_index(PTBL *);
+static int	pt_init(PTBL *);
+#ifdef HAVE_PTHREAD
+static void	*pt_load(void *);
+#endif
+static size_t	pt_ostart(PTBL *, size_t);
+static int	pt_fill(PTBL *, size_t);
+static int	pt_read(PTBL *, char *, int);
+static void	pt_renumber(PTBL *, size_t, size_t);
+static int	pt_split(PTBL *, size_t, size_t);
+static int	pt_wait(PTBL *, recno_t);
+
+/*
+ * ls_piece_open --
+ *	Open a piece table line store.  The file fname, if not NULL, is the
+ *	initial contents of the store, the file bfname, if not NULL, is the
+ *	file the contents are written to when the store is synced.  If
+ *	snapshot isn't set, the file may be mapped instead of read.
+ *
+ * PUBLIC: LSTORE *ls_piece_open(char *, char *, int);
+ */
+LSTORE *
+ls_piece_open(char *fname, char *bfname, int snapshot)
+{
+	LSTORE *ls;
+	PTBL *pt;
+
+	if ((ls = calloc(1, sizeof(LSTORE))) == NULL)
+		return (NULL);
+	if ((pt = calloc(1, sizeof(PTBL))) == NULL) {
+		free(ls);
+		return (NULL);
+	}
+	pt->fd = -1;
+	ls->internal = pt;
+
+	if (bfname != NULL && (pt->bfname = strdup(bfname)) == NULL)
+		goto err;
+	if (fname != NULL && pt_read(pt, fname, snapshot))
+		goto err;
+
+#ifdef HAVE_PTHREAD
+	/* Index large files in the background. */
+	if ((pt->olen >= PT_ASYNCLEN || pt->oread) &&
+	    pthread_mutex_init(&pt->lmtx, NULL) == 0) {
+		if (pthread_cond_init(&pt->lcond, NULL) == 0) {
+			pt->loading = PT_LOADING;
+			if (pthread_create(&pt->lthread, NULL, pt_load, pt) == 0)
+				goto done;
+			pt->loading = 0;
+			(void)pthread_cond_destroy(&pt->lcond);
+		}
+		(void)pthread_mutex_destroy(&pt->lmtx);
+	}
+#endif
+	if (pt_index(pt) || pt_init(pt))
+		goto err;
+
+done:	ls->close = piece_close;
+	ls->del = piece_del;
+	ls->fd = piece_fd;
+	ls->get = piece_get;
+	ls->iafter = piece_iafter;
+	ls->last = piece_last;
+	ls->loaded = piece_loaded;
+	ls->put = piece_put;
+	ls->snapshot = piece_snapshot;
+	ls->span = piece_span;
+	ls->sync = piece_sync;
+	return (ls);
+
+err:	(void)piece_close(ls);
+	return (NULL);
+}
+
+static int
+piece_close(LSTORE *ls)
+{
+	PTBL *pt = ls->internal;
+	size_t i;
+
+#ifdef HAVE_PTHREAD
+	if (pt->loading == PT_LOADING) {
+		(void)pthread_mutex_lock(&pt->lmtx);
+		pt->lstop = 1;
+		(void)pthread_mutex_unlock(&pt->lmtx);
+		(void)pt_wait(pt, PT_WAITALL);
+	}
+#endif
+	if (pt->fd != -1)
+		(void)close(pt->fd);
+	for (i = 0; i < pt->nblk; ++i)
+		free(pt->blk[i]);
+	free(pt->blk);
+	free(pt->add);
+	free(pt->pc);
+	free(pt->ock);
+	free(pt->orel);
+	if (pt->mapped)
+		(void)munmap(pt->obuf, pt->olen);
+	else
+		free(pt->obuf);
+	free(pt->bfname);
+	free(pt);
+	free(ls);
+	return (0);
+}
+
+static int
+piece_fd(LSTORE *ls)
+{
+	PTBL *pt = ls->internal;
+
+	return (pt->fd);
+}
+
+static int
+piece_get(LSTORE *ls, recno_t lno, char **pp, size_t *lenp)
+{
+	PTBL *pt = ls->internal;
+	PIECE *pcp;
+	size_t i, idx;
+
+	/* Until the index is finished, the file is the original file. */
+	if (pt->loading) {
+		if (lno == 0)
+			return (1);
+		if (pt_wait(pt, lno))
+			return (-1);
+		if (pt->loading) {
+			PT_LOCK(pt);
+			idx = lno - 1;
+			*pp = pt->obuf + pt_ostart(pt, idx);
+			*lenp = pt_ostart(pt, idx + 1) - (*pp - pt->obuf) - 1;
+			PT_UNLOCK(pt);
+			return (0);
+		}
+	}
+
+	if (pt_find(pt, lno, &i))
+		return (1);
+	pcp = &pt->pc[i];
+	idx = pcp->first + (lno - pcp->lno);
+	if (pcp->buf == PC_ORIG) {
+		*pp = pt->obuf + pt_ostart(pt, idx);
+		*lenp = pt_ostart(pt, idx + 1) - (*pp - pt->obuf) - 1;
+	} else {
+		*pp = pt->add[idx].p;
+		*lenp = pt->add[idx].len;
+	}
+	return (0);
+}
+
+static int
+piece_last(LSTORE *ls, recno_t *lnop)
+{
+	PTBL *pt = ls->internal;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+	*lnop = pt->nlines;
+	return (0);
+}
+
+static int
+piece_loaded(LSTORE *ls, recno_t *lnop)
+{
+	PTBL *pt = ls->internal;
+
+	if (pt->loading) {
+		if (pt_wait(pt, 0))
+			return (-1);
+		if (pt->loading) {
+			PT_LOCK(pt);
+			*lnop = pt->onlines;
+			PT_UNLOCK(pt);
+			return (1);
+		}
+	}
+	*lnop = pt->nlines;
+	return (0);
+}
+
+static int
+piece_put(LSTORE *ls, recno_t lno, char *p, size_t len)
+{
+	PTBL *pt = ls->internal;
+	PIECE *pcp, orig;
+	size_t i, k, n;
+	recno_t off;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+
+	if (lno == 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	/* Like DB_RECNO, storing past the end of the file appends. */
+	while (lno > pt->nlines + 1)
+		if (piece_iafter(ls, pt->nlines, "", 0))
+			return (-1);
+	if (lno == pt->nlines + 1)
+		return (piece_iafter(ls, pt->nlines, p, len));
+
+	if (pt_addline(pt, p, len, &k) || pt_find(pt, lno, &i))
+		return (-1);
+	pcp = &pt->pc[i];
+	off = lno - pcp->lno;
+
+	/* A single line from the add buffer is simply redirected. */
+	if (pcp->buf == PC_ADD && pcp->cnt == 1) {
+		pcp->first = k;
+		return (0);
+	}
+
+	/* Extend the previous piece if the new line follows it. */
+	if (off == 0 && i > 0 && pcp[-1].buf == PC_ADD &&
+	    pcp[-1].first + pcp[-1].cnt == k) {
+		++pcp[-1].cnt;
+		++pcp->first;
+		++pcp->lno;
+		if (--pcp->cnt == 0) {
+			memmove(pcp, pcp + 1,
+			    (pt->npc - i - 1) * sizeof(PIECE));
+			--pt->npc;
+		}
+		return (0);
+	}
+
+	/* Split into the lines before, the new line, the lines after. */
+	orig = *pcp;
+	n = (off != 0) + 1 + (off != orig.cnt - 1);
+	if (pt_split(pt, i, n))
+		return (-1);
+	pcp = &pt->pc[i];
+	if (off != 0) {
+		pcp->cnt = off;
+		++pcp;
+	}
+	pcp->buf = PC_ADD;
+	pcp->first = k;
+	pcp->cnt = 1;
+	if (off != orig.cnt - 1) {
+		++pcp;
+		pcp->first = orig.first + off + 1;
+		pcp->cnt = orig.cnt - off - 1;
+	}
+	pt_renumber(pt, i, i + n);
+	return (0);
+}
+
+static int
+piece_iafter(LSTORE *ls, recno_t lno, char *p, size_t len)
+{
+	PTBL *pt = ls->internal;
+	PIECE *pcp;
+	size_t i, k;
+	recno_t off;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+
+	if (lno > pt->nlines) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (pt_addline(pt, p, len, &k))
+		return (-1);
+
+	if (lno == 0) {
+		i = 0;
+		off = 0;
+	} else {
+		if (pt_find(pt, lno, &i))
+			return (-1);
+		pcp = &pt->pc[i];
+		off = lno - pcp->lno + 1;
+
+		/* Extend the piece if the new line follows it. */
+		if (off == pcp->cnt && pcp->buf == PC_ADD &&
+		    pcp->first + pcp->cnt == k) {
+			++pcp->cnt;
+			++pt->nlines;
+			pt_renumber(pt, i + 1, pt->npc);
+			return (0);
+		}
+		if (off == pcp->cnt) {
+			++i;
+			off = 0;
+		}
+	}
+
+	/* Insert at a piece boundary, or split the piece. */
+	if (off == 0) {
+		if (pt_grow(&pt->pc, &pt->pclen, pt->npc + 1, sizeof(PIECE)))
+			return (-1);
+		memmove(pt->pc + i + 1,
+		    pt->pc + i, (pt->npc - i) * sizeof(PIECE));
+		++pt->npc;
+		pcp = &pt->pc[i];
+	} else {
+		if (pt_split(pt, i, 3))
+			return (-1);
+		pcp = &pt->pc[i];
+		pcp[2].first += off;
+		pcp[2].cnt -= off;
+		pcp[0].cnt = off;
+		++pcp;
+	}
+	pcp->buf = PC_ADD;
+	pcp->first = k;
+	pcp->cnt = 1;
+	++pt->nlines;
+	pt_renumber(pt, i, pt->npc);
+	return (0);
+}
+
+static int
+piece_del(LSTORE *ls, recno_t lno, recno_t cnt)
+{
+	PTBL *pt = ls->internal;
+	PIECE *pcp;
+	size_t i, j, s, e;
+	recno_t off, tail;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+
+	if (cnt == 0 || cnt > pt->nlines || lno > pt->nlines - cnt + 1 ||
+	    pt_find(pt, lno + cnt - 1, &j) || pt_find(pt, lno, &i))
+		return (1);
+
+	/* The lines kept from the first and last pieces of the range. */
+	off = lno - pt->pc[i].lno;
+	tail = pt->pc[j].lno + pt->pc[j].cnt - (lno + cnt);
+
+	/* Lines inside a single piece split it. */
+	if (i == j && off != 0 && tail != 0) {
+		if (pt_split(pt, i, 2))
+			return (-1);
+		pcp = &pt->pc[i];
+		pcp[1].first += off + cnt;
+		pcp[1].cnt = tail;
+		pcp[0].cnt = off;
+		pt->nlines -= cnt;
+		pt_renumber(pt, i + 1, pt->npc);
+		return (0);
+	}
+
+	/*
+	 * Otherwise, trim the first and last pieces, and remove them if
+	 * they're emptied, along with all of the pieces between them.
+	 */
+	if (i != j || off == 0) {
+		pt->pc[j].first += pt->pc[j].cnt - tail;
+		pt->pc[j].cnt = tail;
+	}
+	if (i != j || tail == 0)
+		pt->pc[i].cnt = off;
+	s = off == 0 ? i : i + 1;
+	e = tail == 0 ? j + 1 : j;
+	if (e > s) {
+		memmove(pt->pc + s, pt->pc + e, (pt->npc - e) * sizeof(PIECE));
+		pt->npc -= e - s;
+	}
+
+	/* Rejoin the neighbors if they're contiguous. */
+	pcp = &pt->pc[s];
+	if (s > 0 && s < pt->npc && pcp[-1].buf == pcp->buf &&
+	    pcp[-1].first + pcp[-1].cnt == pcp->first) {
+		pcp[-1].cnt += pcp->cnt;
+		memmove(pcp, pcp + 1, (pt->npc - s - 1) * sizeof(PIECE));
+		--pt->npc;
+	}
+	pt->nlines -= cnt;
+	pt_renumber(pt, s, pt->npc);
+	return (0);
+}
+
+static int
+piece_sync(LSTORE *ls)
+{
+	PTBL *pt = ls->internal;
+	FILE *fp;
+	PIECE *pcp;
+	size_t i, j, len, start, end;
+	int fd;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+
+	if (pt->bfname == NULL)
+		return (0);
+	if ((fd = open(pt->bfname, O_WRONLY | O_CREAT | O_TRUNC,
+	    S_IRUSR | S_IWUSR)) < 0)
+		return (-1);
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		(void)close(fd);
+		return (-1);
+	}
+
+	/*
+	 * Runs of original lines are contiguous in the original buffer,
+	 * write them with a single call, supplying the <newline> if the
+	 * original file didn't end with one.
+	 */
+	for (i = 0, pcp = pt->pc; i < pt->npc; ++i, ++pcp)
+		if (pcp->buf == PC_ORIG) {
+			start = pt_ostart(pt, pcp->first);
+			end = pt_ostart(pt, pcp->first + pcp->cnt);
+			len = MIN(end, pt->olen) - start;
+			if (fwrite(pt->obuf + start, 1, len, fp) != len ||
+			    (end > pt->olen && putc('\n', fp) == EOF))
+				goto err;
+		} else
+			for (j = 0; j < pcp->cnt; ++j) {
+				len = pt->add[pcp->first + j].len;
+				if (fwrite(pt->add[pcp->first + j].p,
+				    1, len, fp) != len || putc('\n', fp) == EOF)
+					goto err;
+			}
+	if (fflush(fp) || fsync(fileno(fp)))
+		goto err;
+	return (fclose(fp) ? -1 : 0);
+
+err:	(void)fclose(fp);
+	return (-1);
+}
+
+static int
+piece_span(LSTORE *ls,
+    recno_t lno, recno_t cnt, char **pp, size_t *lenp, recno_t *np)
+{
+	PTBL *pt = ls->internal;
+	PIECE *pcp;
+	size_t i, idx, start;
+	recno_t n;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+
+	*np = 0;
+	if (pt_find(pt, lno, &i))
+		return (1);
+	pcp = &pt->pc[i];
+	if (pcp->buf != PC_ORIG)
+		return (0);
+
+	/*
+	 * A run of original lines is contiguous in the original buffer,
+	 * except that the last line of a file that didn't end with a
+	 * <newline> has to be returned by the get method.
+	 */
+	idx = pcp->first + (lno - pcp->lno);
+	n = MIN(cnt, pcp->cnt - (lno - pcp->lno));
+	if (idx + n == pt->onlines && pt->oend > pt->olen && --n == 0)
+		return (0);
+	start = pt_ostart(pt, idx);
+	*pp = pt->obuf + start;
+	*lenp = pt_ostart(pt, idx + n) - start;
+	*np = n;
+	return (0);
+}
+
+static int
+piece_snapshot(LSTORE *ls)
+{
+	PTBL *pt = ls->internal;
+	char *p;
+
+	if (pt->loading && pt_wait(pt, PT_WAITALL))
+		return (-1);
+
+	if (!pt->mapped)
+		return (0);
+	if ((p = malloc(pt->olen)) == NULL)
+		return (-1);
+	memcpy(p, pt->obuf, pt->olen);
+	(void)munmap(pt->obuf, pt->olen);
+	pt->obuf = p;
+	pt->mapped = 0;
+	return (0);
+}
+
+/*
+ * pt_read --
+ *	Read or map the original file into memory, keeping the descriptor
+ *	open for locking.
+ */
+static int
+pt_read(PTBL *pt, char *fname, int snapshot)
+{
+	struct stat sb;
+	ssize_t nr;
+	size_t len;
+
+	/*
+	 * Open non-blocking so opening a FIFO doesn't hang, like dbopen(3),
+	 * then block for the reads.
+	 */
+	if ((pt->fd = open(fname, O_RDONLY | O_NONBLOCK)) < 0)
+		return (1);
+	if (fcntl(pt->fd, F_SETFL, 0) == -1 || fstat(pt->fd, &sb))
+		return (1);
+
+	/* Map non-empty regular files, falling back to reading them. */
+	if (!snapshot && S_ISREG(sb.st_mode) &&
+	    sb.st_size > 0 && (off_t)(size_t)sb.st_size == sb.st_size &&
+	    (pt->obuf = mmap(NULL, sb.st_size,
+	    PROT_READ, MAP_PRIVATE, pt->fd, 0)) != MAP_FAILED) {
+		pt->olen = sb.st_size;
+		pt->mapped = 1;
+		return (0);
+	}
+	pt->obuf = NULL;
+
+#ifdef HAVE_PTHREAD
+	/*
+	 * Large regular files are read as they're indexed, by the index
+	 * thread.  The buffer is never reallocated, lines handed out from
+	 * it have to stay put, so the file is read up to its current size.
+	 */
+	if (S_ISREG(sb.st_mode) && sb.st_size >= PT_ASYNCLEN &&
+	    (off_t)(size_t)sb.st_size == sb.st_size) {
+		if ((pt->obuf = malloc(sb.st_size)) == NULL)
+			return (1);
+		pt->osize = sb.st_size;
+		pt->oread = 1;
+		return (0);
+	}
+#endif
+
+	/*
+	 * Read until EOF -- the file size is only a starting point, as the
+	 * file may not be a regular file, or may be growing.
+	 */
+	len = S_ISREG(sb.st_mode) && sb.st_size > 0 ? sb.st_size + 1 : 1024;
+	if ((pt->obuf = malloc(len)) == NULL)
+		return (1);
+	for (pt->olen = 0;;) {
+		if (pt->olen == len) {
+			if (pt_grow(&pt->obuf, &len, len + 1, 1))
+				return (1);
+		}
+		if ((nr = read(pt->fd, pt->obuf + pt->olen,
+		    len - pt->olen)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (1);
+		}
+		if (nr == 0)
+			break;
+		pt->olen += nr;
+	}
+	return (0);
+}
+
+/*
+ * pt_fill --
+ *	Read more of the original file, at least as much as has been read
+ *	but not yet indexed, so a line that spans reads isn't rescanned
+ *	more than a few times.
+ */
+static int
+pt_fill(PTBL *pt, size_t want)
+{
+	ssize_t nr;
+	size_t len;
+
+	want = MAX(want, PT_READLEN);
+	for (len = pt->olen;;) {
+		if ((nr = read(pt->fd,
+		    pt->obuf + len, MIN(pt->osize - len, want))) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (1);
+		}
+		len += nr;
+		if (nr == 0 || len == pt->osize || len - pt->olen >= want)
+			break;
+	}
+
+	PT_LOCK(pt);
+	if (nr == 0 || len == pt->osize)
+		pt->oread = 0;
+	pt->olen = len;
+	PT_UNLOCK(pt);
+	return (0);
+}
+
+/*
+ * pt_index --
+ *	Count the lines of the original buffer, and build its line index.
+ */
+static int
+pt_index(PTBL *pt)
+{
+	size_t cnt, i, n, off, rel, cklen, rellen;
+	size_t offs[PT_CKLINES];
+	int rval;
+
+	/*
+	 * Each scan finds the lines following one checkpoint.  The start of
+	 * the line following the lines found so far is always indexed, so a
+	 * line's length is known as soon as the line is counted.
+	 */
+	cklen = rellen = 0;
+	if (pt_grow(&pt->ock, &cklen, 64, sizeof(size_t)) ||
+	    pt_grow(&pt->orel, &rellen, 64, sizeof(u_int32_t)))
+		return (1);
+	pt->ock[0] = 0;
+	pt->orel[0] = 0;
+	for (cnt = rel = 0, off = 0; off < pt->olen || pt->oread;) {
+		if (cnt / PT_CKLINES + 2 > cklen ||
+		    cnt + PT_CKLINES + 1 > rellen) {
+			PT_LOCK(pt);
+			rval = pt_grow(&pt->ock, &cklen,
+			    cnt / PT_CKLINES + 2, sizeof(size_t)) ||
+			    pt_grow(&pt->orel, &rellen,
+			    cnt + PT_CKLINES + 1, sizeof(u_int32_t));
+			PT_UNLOCK(pt);
+			if (rval)
+				return (1);
+		}
+		n = nl_scan(pt->obuf + off, pt->olen - off, offs, PT_CKLINES);
+		if (n < PT_CKLINES && pt->oread) {
+			if (pt_fill(pt, pt->olen - off))
+				return (1);
+			continue;
+		}
+		for (i = 0; i < n; ++i)
+			pt->orel[cnt + i + 1] = MIN(offs[i], PT_NOREL);
+
+		/* The last line may not end with a <newline>. */
+		if (n < PT_CKLINES) {
+			if (n == 0 || off + offs[n - 1] < pt->olen)
+				++n;
+			cnt += n;
+			break;
+		}
+		cnt += n;
+		off += offs[n - 1];
+		pt->ock[cnt / PT_CKLINES] = off;
+		pt->orel[cnt] = 0;
+
+#ifdef HAVE_PTHREAD
+		/* Publish the lines indexed so far. */
+		if (pt->loading && cnt % PT_LPUBLISH == 0) {
+			(void)pthread_mutex_lock(&pt->lmtx);
+			pt->onlines = cnt;
+			(void)pthread_cond_broadcast(&pt->lcond);
+			rval = pt->lstop;
+			(void)pthread_mutex_unlock(&pt->lmtx);
+			if (rval) {
+				errno = EINTR;
+				return (1);
+			}
+		}
+#endif
+#ifdef MADV_DONTNEED
+		/*
+		 * Release the mapped pages already scanned, they're cached by
+		 * the system, and the index is all that's needed from them.
+		 */
+		if (pt->mapped && off - rel >= PT_MAPCHUNK) {
+			(void)madvise(pt->obuf + rel,
+			    PT_MAPCHUNK, MADV_DONTNEED);
+			rel += PT_MAPCHUNK;
+		}
+#endif
+	}
+
+	/* The sentinel supplies a <newline> to an unterminated last line. */
+	PT_LOCK(pt);
+	pt->oend = pt->olen != 0 && pt->obuf[pt->olen - 1] != '\n' ?
+	    pt->olen + 1 : pt->olen;
+	pt->onlines = cnt;
+	PT_UNLOCK(pt);
+	return (0);
+}
+
+/*
+ * pt_init --
+ *	Finish opening the store, once the line index is built.
+ */
+static int
+pt_init(PTBL *pt)
+{
+	/* The entire original file is the first piece. */
+	if (pt->onlines != 0) {
+		if (pt_grow(&pt->pc, &pt->pclen, 1, sizeof(PIECE)))
+			return (1);
+		pt->pc[0].buf = PC_ORIG;
+		pt->pc[0].first = 0;
+		pt->pc[0].cnt = pt->onlines;
+		pt->pc[0].lno = 1;
+		pt->npc = 1;
+	}
+	pt->nlines = pt->onlines;
+	return (0);
+}
+
+#ifdef HAVE_PTHREAD
+/*
+ * pt_load --
+ *	Build the line index in the background.
+ */
+static void *
+pt_load(void *arg)
+{
+	PTBL *pt = arg;
+	int lerr;
+
+	lerr = pt_index(pt) ? (errno == 0 ? ENOMEM : errno) : 0;
+	(void)pthread_mutex_lock(&pt->lmtx);
+	pt->lerr = lerr;
+	pt->ldone = 1;
+	(void)pthread_cond_broadcast(&pt->lcond);
+	(void)pthread_mutex_unlock(&pt->lmtx);
+	return (NULL);
+}
+#endif
+
+/*
+ * pt_wait --
+ *	Wait for the line index to reach line lno, or to be finished.  If
+ *	it's finished, finish opening the store.
+ */
+static int
+pt_wait(PTBL *pt, recno_t lno)
+{
+#ifdef HAVE_PTHREAD
+	int done;
+
+	if (pt->loading == PT_LFAILED) {
+		errno = pt->lerr;
+		return (-1);
+	}
+	(void)pthread_mutex_lock(&pt->lmtx);
+	while (!pt->ldone && pt->onlines < lno)
+		(void)pthread_cond_wait(&pt->lcond, &pt->lmtx);
+	done = pt->ldone;
+	(void)pthread_mutex_unlock(&pt->lmtx);
+	if (!done)
+		return (0);
+
+	(void)pthread_join(pt->lthread, NULL);
+	(void)pthread_cond_destroy(&pt->lcond);
+	(void)pthread_mutex_destroy(&pt->lmtx);
+	if (pt->lerr != 0 || pt_init(pt)) {
+		if (pt->lerr == 0)
+			pt->lerr = errno;
+		pt->loading = PT_LFAILED;
+		errno = pt->lerr;
+		return (-1);
+	}
+	pt->loading = 0;
+#endif
+	return (0);
+}
+
+/*
+ * pt_ostart --
+ *	Return the offset of the start of an original line, or of the
+ *	sentinel.
+ */
+static size_t
+pt_ostart(PTBL *pt, size_t idx)
+{
+	size_t n, off;
+	char *q;
+
+	/* While loading, the line following the last one counted is known. */
+	if (idx >= pt->onlines && !pt->loading)
+		return (pt->oend);
+	off = pt->ock[idx / PT_CKLINES];
+	if (pt->orel[idx] != PT_NOREL)
+		return (off + pt->orel[idx]);
+
+	/*
+	 * The line is more than PT_NOREL bytes from its checkpoint, scan
+	 * from the checkpoint.  Every line before the last one ends with
+	 * a <newline>.
+	 */
+	for (n = idx - idx % PT_CKLINES; n < idx; ++n) {
+		q = memchr(pt->obuf + off, '\n', pt->olen - off);
+		off = q - pt->obuf + 1;
+	}
+	return (off);
+}
+
+/*
+ * pt_addline --
+ *	Copy a line into the add buffer.
+ */
+static int
+pt_addline(PTBL *pt, char *p, size_t len, size_t *kp)
+{
+	char *bp;
+
+	if (pt_grow(&pt->add, &pt->addlen, pt->nadd + 1, sizeof(ALINE)) ||
+	    pt_grow(&pt->blk, &pt->blklen, pt->nblk + 1, sizeof(char *)))
+		return (1);
+
+	/*
+	 * Lines larger than half a block get a block to themselves, so they
+	 * don't waste space.  Other lines are packed into the current block,
+	 * starting a new one when it fills.
+	 */
+	if (len > PT_BLKSIZE / 2) {
+		if ((bp = malloc(len)) == NULL)
+			return (1);
+		pt->blk[pt->nblk++] = bp;
+	} else {
+		if (pt->cur == NULL || len > PT_BLKSIZE - pt->bused) {
+			if ((pt->cur = malloc(PT_BLKSIZE)) == NULL)
+				return (1);
+			pt->blk[pt->nblk++] = pt->cur;
+			pt->bused = 0;
+		}
+		bp = pt->cur + pt->bused;
+		pt->bused += len;
+	}
+	memcpy(bp, p, len);
+
+	pt->add[pt->nadd].p = bp;
+	pt->add[pt->nadd].len = len;
+	*kp = pt->nadd++;
+	return (0);
+}
+
+/*
+ * pt_find --
+ *	Find the piece holding a line.
+ */
+static int
+pt_find(PTBL *pt, recno_t lno, size_t *ip)
+{
+	PIECE *pcp;
+	size_t base, i, lim;
+
+	if (lno == 0 || lno > pt->nlines)
+		return (1);
+
+	/* Check the last piece used, and the one following it. */
+	for (i = pt->hint; i < pt->npc && i < pt->hint + 2; ++i) {
+		pcp = &pt->pc[i];
+		if (lno >= pcp->lno && lno < pcp->lno + pcp->cnt)
+			goto found;
+	}
+
+	for (base = 0, lim = pt->npc; lim != 0; lim >>= 1) {
+		i = base + (lim >> 1);
+		pcp = &pt->pc[i];
+		if (lno < pcp->lno)
+			continue;
+		if (lno < pcp->lno + pcp->cnt)
+			goto found;
+		base = i + 1;
+		--lim;
+	}
+	abort();
+
+found:	*ip = pt->hint = i;
+	return (0);
+}
+
+/*
+ * pt_split --
+ *	Replace piece i with n copies of itself, the caller adjusts them.
+ */
+static int
+pt_split(PTBL *pt, size_t i, size_t n)
+{
+	PIECE *pcp;
+	size_t j;
+
+	if (pt_grow(&pt->pc, &pt->pclen, pt->npc + n - 1, sizeof(PIECE)))
+		return (1);
+	pcp = &pt->pc[i];
+	memmove(pcp + n, pcp + 1, (pt->npc - i - 1) * sizeof(PIECE));
+	for (j = 1; j < n; ++j)
+		pcp[j] = pcp[0];
+	pt->npc += n - 1;
+	return (0);
+}
+
+/*
+ * pt_renumber --
+ *	Reset the first line number of pieces from..to-1.
+ */
+static void
+pt_renumber(PTBL *pt, size_t from, size_t to)
+{
+	PIECE *pcp;
+	recno_t lno;
+
+	if (from >= pt->npc)
+		return;
+	lno = from == 0 ? 1 : pt->pc[from - 1].lno + pt->pc[from - 1].cnt;
+	for (pcp = pt->pc + from; from < to && from < pt->npc; ++from, ++pcp) {
+		pcp->lno = lno;
+		lno += pcp->cnt;
+	}
+}
+
+/*
+ * pt_grow --
+ *	Grow an array to hold at least n elements.
+ */
+static int
+pt_grow(void *arg, size_t *lenp, size_t n, size_t size)
+{
+	void **pp = arg, *p;
+	size_t len;
+
+	if (n <= *lenp)
+		return (0);
+	for (len = *lenp == 0 ? 64 : *lenp; len < n; len <<= 1);
+	if ((p = realloc(*pp, len * size)) == NULL)
+		return (1);
+	*pp = p;
+	*lenp = len;
+	return (0);
+}
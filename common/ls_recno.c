@@ -0,0 +1,226 @@
+/*-
+ * See the LICENSE file for redistribution information.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <bitstring.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+/*
+ * The recno line store is a thin layer over a 4.4BSD db(3) DB_RECNO
+ * database, which is how nvi has always stored the edit buffer.  The
+ * database's record numbers are 32 bits, lines past the last record
+ * number don't exist, and can't be created.
+ */
+#define	RECNO_KEY(key, dlno, lno) {					\
+	(dlno) = (lno);							\
+	(key).data = &(dlno);						\
+	(key).size = sizeof(dlno);					\
+}
+static int	recno_close(LSTORE *);
+static int	recno_del(LSTORE *, recno_t, recno_t);
+static int	recno_fd(LSTORE *);
+static int	recno_get(LSTORE *, recno_t, char **, size_t *);
+static int	recno_iafter(LSTORE *, recno_t, char *, size_t);
+static int	recno_last(LSTORE *, recno_t *);
+static int	recno_loaded(LSTORE *, recno_t *);
+static int	recno_put(LSTORE *, recno_t, char *, size_t);
+static int	recno_snapshot(LSTORE *);
+static int	recno_span(LSTORE *, recno_t, recno_t, char **, size_t *, recno_t *);
+static int	recno_sync(LSTORE *);
+
+/*
+ * ls_recno_open --
+ *	Open a DB_RECNO line store.  If fname is NULL, the database is
+ *	read from the btree file named in the RECNOINFO structure.
+ *
+ * PUBLIC: LSTORE *ls_recno_open(char *, RECNOINFO *);
+ */
+LSTORE *
+ls_recno_open(char *fname, RECNOINFO *oinfo)
+{
+	LSTORE *ls;
+	DB *db;
+
+	if ((ls = calloc(1, sizeof(LSTORE))) == NULL)
+		return (NULL);
+	if ((db = dbopen(fname, O_NONBLOCK | O_RDONLY,
+	    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH,
+	    DB_RECNO, oinfo)) == NULL) {
+		free(ls);
+		return (NULL);
+	}
+
+	ls->close = recno_close;
+	ls->del = recno_del;
+	ls->fd = recno_fd;
+	ls->get = recno_get;
+	ls->iafter = recno_iafter;
+	ls->last = recno_last;
+	ls->loaded = recno_loaded;
+	ls->put = recno_put;
+	ls->snapshot = recno_snapshot;
+	ls->span = recno_span;
+	ls->sync = recno_sync;
+	ls->internal = db;
+	return (ls);
+}
+
+static int
+recno_close(LSTORE *ls)
+{
+	DB *db = ls->internal;
+	int rval;
+
+	rval = db->close != NULL ? db->close(db) : 0;
+	free(ls);
+	return (rval);
+}
+
+static int
+recno_del(LSTORE *ls, recno_t lno, recno_t cnt)
+{
+	DB *db = ls->internal;
+	DBT key;
+	db_recno_t dlno;
+	recno_t l;
+	int rval;
+
+	/* Delete from the end, so the lines don't move as they're deleted. */
+	for (l = lno + cnt; l-- > lno;) {
+		RECNO_KEY(key, dlno, l);
+		if ((rval = db->del(db, &key, 0)) != 0)
+			return (rval);
+	}
+	return (0);
+}
+
+static int
+recno_fd(LSTORE *ls)
+{
+	DB *db = ls->internal;
+
+	return (db->fd(db));
+}
+
+static int
+recno_get(LSTORE *ls, recno_t lno, char **pp, size_t *lenp)
+{
+	DB *db = ls->internal;
+	DBT data, key;
+	db_recno_t dlno;
+	int rval;
+
+	if (lno > DB_MAX_REC_NUMBER)
+		return (1);
+	RECNO_KEY(key, dlno, lno);
+	if ((rval = db->get(db, &key, &data, 0)) == 0) {
+		*pp = data.data;
+		*lenp = data.size;
+	}
+	return (rval);
+}
+
+static int
+recno_iafter(LSTORE *ls, recno_t lno, char *p, size_t len)
+{
+	DB *db = ls->internal;
+	DBT data, key;
+	db_recno_t dlno;
+
+	if (lno >= DB_MAX_REC_NUMBER) {
+		errno = EFBIG;
+		return (-1);
+	}
+
+	/*
+	 * DB_RECNO converts an R_IAFTER of record 0 into an R_IBEFORE of
+	 * record 1, which is exactly the semantic we want.
+	 */
+	RECNO_KEY(key, dlno, lno);
+	data.data = p;
+	data.size = len;
+	return (db->put(db, &key, &data, R_IAFTER));
+}
+
+static int
+recno_last(LSTORE *ls, recno_t *lnop)
+{
+	DB *db = ls->internal;
+	DBT data, key;
+	db_recno_t dlno;
+	int rval;
+
+	key.data = &dlno;
+	key.size = sizeof(dlno);
+	switch (rval = db->seq(db, &key, &data, R_LAST)) {
+	case 0:
+		memcpy(&dlno, key.data, sizeof(db_recno_t));
+		*lnop = dlno;
+		break;
+	case 1:
+		*lnop = 0;
+		rval = 0;
+		break;
+	}
+	return (rval);
+}
+
+static int
+recno_loaded(LSTORE *ls, recno_t *lnop)
+{
+	return (recno_last(ls, lnop));
+}
+
+static int
+recno_put(LSTORE *ls, recno_t lno, char *p, size_t len)
+{
+	DB *db = ls->internal;
+	DBT data, key;
+	db_recno_t dlno;
+
+	if (lno > DB_MAX_REC_NUMBER) {
+		errno = EFBIG;
+		return (-1);
+	}
+	RECNO_KEY(key, dlno, lno);
+	data.data = p;
+	data.size = len;
+	return (db->put(db, &key, &data, 0));
+}
+
+static int
+recno_snapshot(LSTORE *ls)
+{
+	/* DB_RECNO reads the file itself, the R_SNAPSHOT flag decides when. */
+	return (0);
+}
+
+static int
+recno_span(LSTORE *ls,
+    recno_t lno, recno_t cnt, char **pp, size_t *lenp, recno_t *np)
+{
+	/* DB_RECNO records aren't contiguous. */
+	*np = 0;
+	return (0);
+}
+
+static int
+recno_sync(LSTORE *ls)
+{
+	DB *db = ls->internal;
+
+	return (db->sync(db, R_RECNOSYNC));
+}
@@ -0,0 +1,66 @@
+/*-
+ * See the LICENSE file for redistribution information.
+ */
+
+/*
+ * The line store is the storage engine underneath the db_* routines in
+ * line.c.  Like the db(3) interface it replaces, it is a structure of
+ * methods plus an engine private pointer, and, like db(3), the methods
+ * return 0 on success, -1 on error (errno set), and 1 for a line that
+ * doesn't exist.  Lines are stored in the file's encoding, without the
+ * trailing <newline>, and are numbered from 1.
+ *
+ * Lines returned by the get method are owned by the engine, and are only
+ * guaranteed to remain valid until the next call into the same store.
+ *
+ * An engine may finish loading the file after it's opened.  While it's
+ * loading, the get method waits for the line to be loaded, the loaded
+ * method returns 1 and the number of lines available so far, and every
+ * other method waits for the load to finish.
+ *
+ * The span method returns up to a count of lines, starting at a line, that
+ * are stored contiguously, each followed by its <newline>, and the number
+ * of lines returned.  An engine that doesn't store lines that way returns
+ * none, and the caller falls back to the get method.  The text remains
+ * valid until the store is next changed.
+ *
+ * There are currently two engines:
+ *
+ *	recno	The historic 4.4BSD db(3) DB_RECNO engine.
+ *	piece	A piece table over the original file contents and an
+ *		append-only buffer of changed lines.  Unless snapshots
+ *		are required, the original file is mapped, not read.
+ *
+ * The engine is selected, per file, by the linestore edit option when
+ * the file is read in.
+ */
+struct _lstore {
+					/* Close the store. */
+	int	(*close)(LSTORE *);
+					/* Delete a run of lines. */
+	int	(*del)(LSTORE *, recno_t, recno_t);
+					/* Lockable file descriptor. */
+	int	(*fd)(LSTORE *);
+					/* Retrieve a line. */
+	int	(*get)(LSTORE *, recno_t, char **, size_t *);
+					/* Insert a line after a line. */
+	int	(*iafter)(LSTORE *, recno_t, char *, size_t);
+					/* Return the number of lines. */
+	int	(*last)(LSTORE *, recno_t *);
+					/* Return the lines loaded so far. */
+	int	(*loaded)(LSTORE *, recno_t *);
+					/* Replace a line. */
+	int	(*put)(LSTORE *, recno_t, char *, size_t);
+					/* Stop sharing the file's text. */
+	int	(*snapshot)(LSTORE *);
+					/* Return a run of raw lines. */
+	int	(*span)(LSTORE *, recno_t, recno_t, char **, size_t *, recno_t *);
+					/* Sync to the backing file. */
+	int	(*sync)(LSTORE *);
+
+	void	*internal;		/* Engine private information. */
+};
+
+/* Line store engines, stored in the linestore edit option. */
+#define	LS_PIECE	"piece"
+#define	LS_RECNO	"recno"
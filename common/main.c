@@ -69,6 +69,7 @@ editor(GS *gp, int argc, char *argv[])
 
 	/* Structures shared by screens so stored in the GS structure. */
 	TAILQ_INIT(gp->frefq);
+	TAILQ_INIT(gp->recacheq);
 	TAILQ_INIT(gp->dcb_store.textq);
 	SLIST_INIT(gp->cutq);
 	SLIST_INIT(gp->seqq);
@@ -455,6 +456,9 @@ v_end(gp)
 	/* Free map sequences. */
 	seq_close(gp);
 
+	/* Free compiled RE's. */
+	re_cache_trim(gp, 0);
+
 	/* Free default buffer storage. */
 	(void)text_lfree(gp->dcb_store.textq);
 
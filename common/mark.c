@@ -200,12 +200,12 @@ mark_find(SCR *sp, ARG_CHAR_T key)
 
 /*
  * mark_insdel --
- *	Update the marks based on an insertion or deletion.
+ *	Update the marks based on an insertion or deletion of cnt lines.
  *
- * PUBLIC: int mark_insdel(SCR *, lnop_t, recno_t);
+ * PUBLIC: int mark_insdel(SCR *, lnop_t, recno_t, recno_t);
  */
 int
-mark_insdel(SCR *sp, lnop_t op, recno_t lno)
+mark_insdel(SCR *sp, lnop_t op, recno_t lno, recno_t cnt)
 {
 	LMARK *lmp;
 	recno_t lline;
@@ -217,11 +217,12 @@ mark_insdel(SCR *sp, lnop_t op, recno_t lno)
 	case LINE_DELETE:
 		SLIST_FOREACH(lmp, sp->ep->marks, q)
 			if (lmp->lno >= lno)
-				if (lmp->lno == lno) {
+				if (lmp->lno < lno + cnt) {
 					F_SET(lmp, MARK_DELETED);
 					(void)log_mark(sp, lmp);
+					lmp->lno = lno;
 				} else
-					--lmp->lno;
+					lmp->lno -= cnt;
 		break;
 	case LINE_INSERT:
 		/*
@@ -236,18 +237,23 @@ mark_insdel(SCR *sp, lnop_t op, recno_t lno)
 		 * file and replace it, and continue to use the mark.  Insane,
 		 * well, yes, I know, but someone complained.
 		 *
-		 * Check for line #2 before going to the end of the file.
+		 * Check for line #2 before going to the end of the file.  If
+		 * several lines were added to an empty file, the first one is
+		 * the replacement.
 		 */
-		if (!db_exist(sp, 2)) {
+		if (!db_exist(sp, cnt + 1)) {
 			if (db_last(sp, &lline))
 				return (1);
-			if (lline == 1)
-				return (0);
+			if (lline == cnt) {
+				if (--cnt == 0)
+					return (0);
+				++lno;
+			}
 		}
 
 		SLIST_FOREACH(lmp, sp->ep->marks, q)
 			if (lmp->lno >= lno)
-				++lmp->lno;
+				lmp->lno += cnt;
 		break;
 	case LINE_RESET:
 		break;
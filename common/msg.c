@@ -154,7 +154,7 @@ retry:		FREE_SPACE(sp, bp, blen);
 			if ((mlen += len) > blen)
 				goto retry;
 		}
-		len = snprintf(mp, REM, ", %d: ", gp->if_lno);
+		len = snprintf(mp, REM, ", %lu: ", (u_long)gp->if_lno);
 		mp += len;
 		if ((mlen += len) > blen)
 			goto retry;
@@ -620,9 +620,13 @@ msgq_status(SCR *sp, recno_t lno, u_int flags)
 		*p++ = ' ';
 	}
 	if (LF_ISSET(MSTAT_SHOWLAST)) {
-		if (db_last(sp, &last))
+		if (db_loading(sp, &last)) {
+			t = msg_cat(sp, "327|line %lu of %lu+ [loading]", &len);
+			(void)snprintf(p, ep - p, t, (u_long)lno, (u_long)last);
+			p += strlen(p);
+		} else if (db_last(sp, &last))
 			return;
-		if (last == 0) {
+		else if (last == 0) {
 			t = msg_cat(sp, "028|empty file", &len);
 			memcpy(p, t, len);
 			p += len;
@@ -0,0 +1,85 @@
+/*-
+ * See the LICENSE file for redistribution information.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <bitstring.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "common.h"
+
+/*
+ * nl_scan --
+ *	Find up to n <newline>s in the len bytes starting at p, storing the
+ *	offset of the byte following each one in offs, i.e., the offsets of
+ *	the lines that follow them.  Returns the number found, which is less
+ *	than n only if there are no more <newline>s in the buffer.
+ *
+ *	Splitting a file into lines is the one pass the editor makes over
+ *	every byte of a file it reads, so where the compiler targets it the
+ *	buffer is compared a vector at a time, and the <newline>s are pulled
+ *	out of the comparison mask a bit at a time.  Otherwise, memchr(3) is
+ *	used, which is usually vectorized by the C library.
+ *
+ * PUBLIC: size_t nl_scan(const char *, size_t, size_t *, size_t);
+ */
+size_t
+nl_scan(const char *p, size_t len, size_t *offs, size_t n)
+{
+	const char *q;
+	size_t cnt, i;
+
+	cnt = i = 0;
+#if defined(__AVX2__)
+	{
+		__m256i nl;
+		u_int32_t m;
+
+		nl = _mm256_set1_epi8('\n');
+		for (; cnt < n && len - i >= 32; i += 32) {
+			m = (u_int32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			    _mm256_loadu_si256((const __m256i *)(p + i)), nl));
+			for (; m != 0; m &= m - 1) {
+				offs[cnt] = i + ffs((int)m);
+				if (++cnt == n)
+					return (cnt);
+			}
+		}
+	}
+#elif defined(__SSE2__)
+	{
+		__m128i nl;
+		u_int32_t m;
+
+		nl = _mm_set1_epi8('\n');
+		for (; cnt < n && len - i >= 16; i += 16) {
+			m = (u_int32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(
+			    _mm_loadu_si128((const __m128i *)(p + i)), nl));
+			for (; m != 0; m &= m - 1) {
+				offs[cnt] = i + ffs((int)m);
+				if (++cnt == n)
+					return (cnt);
+			}
+		}
+	}
+#endif
+	for (; cnt < n && i < len; i = offs[cnt++]) {
+		if ((q = memchr(p + i, '\n', len - i)) == NULL)
+			break;
+		offs[cnt] = q - p + 1;
+	}
+	return (cnt);
+}
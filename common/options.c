@@ -100,8 +100,12 @@ OPTLIST const optlist[] = {
 	{L("keytime"),	NULL,		OPT_NUM,	0},
 /* O_LEFTRIGHT	  4.4BSD */
 	{L("leftright"),	f_reformat,	OPT_0BOOL,	0},
+/* O_LINECACHE */
+	{L("linecache"),	f_linecache,	OPT_NUM,	0},
 /* O_LINES	  4.4BSD */
 	{L("lines"),	f_lines,	OPT_NUM,	OPT_NOSAVE},
+/* O_LINESTORE */
+	{L("linestore"),	f_linestore,	OPT_STR,	0},
 /* O_LISP	    4BSD
  *	XXX
  *	When the lisp option is implemented, delete the OPT_NOSAVE flag,
@@ -155,6 +159,8 @@ OPTLIST const optlist[] = {
 	{L("prompt"),	NULL,		OPT_1BOOL,	0},
 /* O_READONLY	    4BSD (undocumented) */
 	{L("readonly"),	f_readonly,	OPT_0BOOL,	OPT_ALWAYS},
+/* O_RECACHE */
+	{L("recache"),	f_recache,	OPT_NUM,	0},
 /* O_RECDIR	  4.4BSD */
 	{L("recdir"),	NULL,		OPT_STR,	0},
 /* O_REDRAW	    4BSD */
@@ -169,6 +175,8 @@ OPTLIST const optlist[] = {
 	{L("scroll"),	NULL,		OPT_NUM,	0},
 /* O_SEARCHINCR	  4.4BSD */
 	{L("searchincr"),	NULL,		OPT_0BOOL,	0},
+/* O_SEARCHTHREADS */
+	{L("searchthreads"),	f_searchthreads,	OPT_NUM,	0},
 /* O_SECTIONS	    4BSD */
 	{L("sections"),	NULL,		OPT_STR,	OPT_PAIRS},
 /* O_SECURE	  4.4BSD */
@@ -216,6 +224,12 @@ OPTLIST const optlist[] = {
 	{L("timeout"),	NULL,		OPT_1BOOL,	0},
 /* O_TTYWERASE	  4.4BSD */
 	{L("ttywerase"),	f_ttywerase,	OPT_0BOOL,	0},
+/* O_UNDOCACHE */
+	{L("undocache"),	NULL,		OPT_NUM,	0},
+/* O_UNDOFILE */
+	{L("undofile"),	NULL,		OPT_0BOOL,	0},
+/* O_UNDOLIMIT */
+	{L("undolimit"),	NULL,		OPT_NUM,	0},
 /* O_VERBOSE	  4.4BSD */
 	{L("verbose"),	NULL,		OPT_0BOOL,	0},
 /* O_W1200	    4BSD */
@@ -238,6 +252,8 @@ OPTLIST const optlist[] = {
 	{L("wrapscan"),	NULL,		OPT_1BOOL,	0},
 /* O_WRITEANY	    4BSD */
 	{L("writeany"),	NULL,		OPT_0BOOL,	0},
+/* O_WRITEBUF */
+	{L("writebuf"),	f_writebuf,	OPT_NUM,	0},
 	{NULL},
 };
 
@@ -359,16 +375,20 @@ opts_init(SCR *sp, int *oargs)
 	OI(O_ESCAPETIME, L("escapetime=6"));
 	OI(O_FILEC, L("filec=\t"));
 	OI(O_KEYTIME, L("keytime=6"));
+	OI(O_LINECACHE, L("linecache=16"));
+	OI(O_LINESTORE, L("linestore=recno"));
 	OI(O_MATCHCHARS, L("matchchars=()[]{}"));
 	OI(O_MATCHTIME, L("matchtime=7"));
 	(void)SPRINTF(b2, SIZE(b2), L("msgcat=%s"), _PATH_MSGCAT);
 	OI(O_MSGCAT, b2);
+	OI(O_RECACHE, L("recache=8"));
 	OI(O_REPORT, L("report=5"));
 	OI(O_PARAGRAPHS, L("paragraphs=IPLPPPQPP LIpplpipbp"));
 	(void)SPRINTF(b2, SIZE(b2), L("path=%s"), "");
 	OI(O_PATH, b2);
 	(void)SPRINTF(b2, SIZE(b2), L("recdir=%s"), _PATH_PRESERVE);
 	OI(O_RECDIR, b2);
+	OI(O_SEARCHTHREADS, L("searchthreads=0"));
 	OI(O_SECTIONS, L("sections=NHSHH HUnhsh"));
 	(void)SPRINTF(b2, SIZE(b2),
 	    L("shell=%s"), (s = getenv("SHELL")) == NULL ? _PATH_BSHELL : s);
@@ -379,6 +399,9 @@ opts_init(SCR *sp, int *oargs)
 	OI(O_TABSTOP, L("tabstop=8"));
 	(void)SPRINTF(b2, SIZE(b2), L("tags=%s"), _PATH_TAGS);
 	OI(O_TAGS, b2);
+	OI(O_UNDOCACHE, L("undocache=0"));
+	OI(O_UNDOLIMIT, L("undolimit=0"));
+	OI(O_WRITEBUF, L("writebuf=262144"));
 
 	/*
 	 * XXX
@@ -65,6 +65,24 @@ f_columns(SCR *sp, OPTION *op, char *str, u_long *valp)
 	return (0);
 }
 
+/*
+ * PUBLIC: int f_linecache(SCR *, OPTION *, char *, u_long *);
+ */
+int
+f_linecache(SCR *sp, OPTION *op, char *str, u_long *valp)
+{
+#define	MAXIMUM_LINECACHE	1024
+	if (*valp < 1 || *valp > MAXIMUM_LINECACHE) {
+		msgq(sp, M_ERR,
+		    "326|The linecache option must be between 1 and %d",
+		    MAXIMUM_LINECACHE);
+		return (1);
+	}
+
+	/* Resize the current file's cache. */
+	return (db_csize(sp, *valp));
+}
+
 /*
  * PUBLIC: int f_lines(SCR *, OPTION *, char *, u_long *);
  */
@@ -118,6 +136,21 @@ f_lines(SCR *sp, OPTION *op, char *str, u_long *valp)
 	return (0);
 }
 
+/*
+ * PUBLIC: int f_linestore(SCR *, OPTION *, char *, u_long *);
+ */
+int
+f_linestore(SCR *sp, OPTION *op, char *str, u_long *valp)
+{
+	if (strcmp(str, LS_PIECE) && strcmp(str, LS_RECNO)) {
+		msgq(sp, M_ERR,
+		    "325|The linestore option must be %s or %s",
+		    LS_PIECE, LS_RECNO);
+		return (1);
+	}
+	return (0);
+}
+
 /*
  * PUBLIC: int f_lisp(SCR *, OPTION *, char *, u_long *);
  */
@@ -180,6 +213,25 @@ f_readonly(SCR *sp, OPTION *op, char *str, u_long *valp)
 	return (0);
 }
 
+/*
+ * PUBLIC: int f_recache(SCR *, OPTION *, char *, u_long *);
+ */
+int
+f_recache(SCR *sp, OPTION *op, char *str, u_long *valp)
+{
+#define	MAXIMUM_RECACHE	64
+	if (*valp > MAXIMUM_RECACHE) {
+		msgq(sp, M_ERR,
+		    "330|The recache option may not be larger than %d",
+		    MAXIMUM_RECACHE);
+		return (1);
+	}
+
+	/* Discard the compiled RE's that no longer fit. */
+	re_cache_trim(sp->gp, *valp);
+	return (0);
+}
+
 /*
  * PUBLIC: int f_recompile(SCR *, OPTION *, char *, u_long *);
  */
@@ -187,11 +239,11 @@ int
 f_recompile(SCR *sp, OPTION *op, char *str, u_long *valp)
 {
 	if (F_ISSET(sp, SC_RE_SEARCH)) {
-		regfree(&sp->re_c);
+		re_free(sp, &sp->re_c);
 		F_CLR(sp, SC_RE_SEARCH);
 	}
 	if (F_ISSET(sp, SC_RE_SUBST)) {
-		regfree(&sp->subre_c);
+		re_free(sp, &sp->subre_c);
 		F_CLR(sp, SC_RE_SUBST);
 	}
 	return (0);
@@ -207,6 +259,22 @@ f_reformat(SCR *sp, OPTION *op, char *str, u_long *valp)
 	return (0);
 }
 
+/*
+ * PUBLIC: int f_searchthreads(SCR *, OPTION *, char *, u_long *);
+ */
+int
+f_searchthreads(SCR *sp, OPTION *op, char *str, u_long *valp)
+{
+#define	MAXIMUM_SEARCHTHREADS	64
+	if (*valp > MAXIMUM_SEARCHTHREADS) {
+		msgq(sp, M_ERR,
+		    "331|The searchthreads option may not be larger than %d",
+		    MAXIMUM_SEARCHTHREADS);
+		return (1);
+	}
+	return (0);
+}
+
 /*
  * PUBLIC: int f_ttywerase(SCR *, OPTION *, char *, u_long *);
  */
@@ -281,6 +349,22 @@ f_window(SCR *sp, OPTION *op, char *str, u_long *valp)
 	return (0);
 }
 
+/*
+ * PUBLIC: int f_writebuf(SCR *, OPTION *, char *, u_long *);
+ */
+int
+f_writebuf(SCR *sp, OPTION *op, char *str, u_long *valp)
+{
+#define	MAXIMUM_WRITEBUF	(64 * 1024 * 1024)
+	if (*valp > MAXIMUM_WRITEBUF) {
+		msgq(sp, M_ERR,
+		    "329|The writebuf option must be no larger than %d",
+		    MAXIMUM_WRITEBUF);
+		return (1);
+	}
+	return (0);
+}
+
 /*
  * PUBLIC: int f_encoding(SCR *, OPTION *, char *, u_long *);
  */
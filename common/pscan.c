@@ -0,0 +1,568 @@
+/*-
+ * See the LICENSE file for redistribution information.
+ */
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/queue.h>
+#include <sys/time.h>
+
+#include <bitstring.h>
+#include <errno.h>
+#include <limits.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/*
+ * Parallel line scans.
+ *
+ * Searching a large file, or marking the lines of a large file for a global
+ * command, is almost all converting lines and running them through
+ * regexec(3), and no line depends on any other, so long runs of lines are
+ * split into chunks and the chunks scanned by a pool of worker threads.
+ *
+ * The workers can't call into the screen or the file: db_get() caches and
+ * converts lines in the screen, the line store's get method keeps its own
+ * state, and a compiled RE builds its DFA as it's used.  So, the main thread
+ * collects the chunks, taking runs of lines in place from the line store's
+ * span method and copying the rest, and each worker converts the lines with
+ * its own buffer and matches them with its own copy of the RE, compiled from
+ * the saved pattern.  Nothing changes the file while the main thread waits
+ * for the workers, so the chunks are a snapshot of the lines.
+ *
+ * Chunks are handed out in line order, and finished in line order by the
+ * main thread, which, for a global command, appends the runs of lines each
+ * worker marked in a chunk to the command's ranges.  The scan stops at the
+ * first line found to match, for a search, and at the first line a worker
+ * can't decide, because it can't be converted or regexec(3) fails.  The
+ * caller scans that line again, and reports any error, itself.  Workers
+ * don't scan lines after the line the scan stops at.
+ *
+ * The main thread checks for interrupts, and typed keys if the search is
+ * one the user can type ahead of, and updates the busy message, at least
+ * every PS_POLL milliseconds.
+ */
+#define	PS_CHECK	128		/* Lines scanned between checks. */
+#define	PS_CHUNK	4096		/* Lines per chunk. */
+#define	PS_MAXTHREADS	64		/* Threads, if one per processor. */
+#define	PS_MINLINES	(4 * PS_CHUNK)	/* Fewest lines scanned in parallel. */
+#define	PS_POLL		50		/* Interrupt check interval (ms). */
+#define	PS_SLOTS	4		/* Chunks queued per worker. */
+#define	PS_SPANMIN	256		/* Fewest lines scanned in place. */
+
+#ifdef HAVE_PTHREAD
+typedef struct _psrun {
+	recno_t	 start, stop;		/* Start/stop of the run. */
+} PSRUN;
+
+typedef struct _pschunk {
+	recno_t	 lno;			/* First line. */
+	recno_t	 cnt;			/* Line count. */
+	char	*p;			/* Lines, each followed by <newline>. */
+	size_t	 len;			/* Length of the lines. */
+	char	*bp;			/* Copied lines buffer. */
+	size_t	 blen;			/* Copied lines buffer length. */
+	PSRUN	*runs;			/* Marked runs of lines. */
+	size_t	 nruns;			/* Marked runs count. */
+	size_t	 runslen;		/* Marked runs array length. */
+	int	 busy;			/* Queued or being scanned. */
+} PSCHUNK;
+
+typedef struct _pscan PSCAN;
+
+typedef struct _psworker {
+	PSCAN	*ps;			/* Scan. */
+	pthread_t tid;			/* Thread. */
+	regex_t	 re;			/* Compiled RE. */
+	CONVWIN	 cw;			/* Conversion buffer. */
+} PSWORKER;
+
+struct _pscan {
+	SCR	*sp;			/* Screen, for the conversions. */
+	int	 mark;			/* Mark lines, don't search. */
+	int	 invert;		/* Mark the lines that don't match. */
+	struct _rh *rq;			/* Marked ranges. */
+	struct timespec	*keys;		/* Typed key check, see search_keys. */
+
+	pthread_mutex_t	 mtx;		/* Lock. */
+	pthread_cond_t	 wcond;		/* Workers: chunk queued, or eof. */
+	pthread_cond_t	 mcond;		/* Main thread: chunk scanned. */
+	struct timespec	 poll;		/* Next interrupt check. */
+
+	PSCHUNK	*chunks;		/* Chunk ring. */
+	u_long	 nslots;		/* Chunk ring size. */
+	u_long	 nput;			/* Chunks queued. */
+	u_long	 nget;			/* Chunks taken by workers. */
+	u_long	 ndone;			/* Chunks finished. */
+	recno_t	 stop;			/* Line the scan stops at. */
+	int	 eof;			/* No more chunks. */
+};
+
+static int	ps_fill(SCR *, PSCHUNK *, recno_t, recno_t);
+static int	ps_line(SCR *, PSWORKER *, char *, size_t);
+static int	ps_merge(SCR *, PSCAN *, PSCHUNK *);
+static int	ps_poll(SCR *, PSCAN *, busy_t *);
+static int	ps_run(PSCHUNK *, recno_t);
+static int	ps_scan(SCR *, PSCAN *, recno_t *, recno_t, busy_t *);
+static u_long	ps_threads(SCR *, recno_t, recno_t *);
+static int	ps_wait(SCR *, PSCAN *, busy_t *);
+static void    *ps_worker(void *);
+#endif
+
+/*
+ * ps_search --
+ *	Skip the lines from *lnop to end, or the end of the file if end is
+ *	OOBLNO, that don't match the search RE, scanning them in parallel.
+ *	On return, *lnop is the first line that may match, or the line after
+ *	the last one scanned.  Lines that aren't worth scanning in parallel,
+ *	or can't be, aren't skipped.  Returns 1 if interrupted, or, if tsp
+ *	isn't NULL, if a key is typed.
+ *
+ * PUBLIC: int ps_search(SCR *, recno_t *, recno_t, busy_t *, struct timespec *);
+ */
+int
+ps_search(SCR *sp,
+    recno_t *lnop, recno_t end, busy_t *btp, struct timespec *tsp)
+{
+#ifdef HAVE_PTHREAD
+	PSCAN ps;
+
+	memset(&ps, 0, sizeof(ps));
+	ps.keys = tsp;
+	return (ps_scan(sp, &ps, lnop, end, btp));
+#else
+	return (0);
+#endif
+}
+
+/*
+ * ps_mark --
+ *	Append the lines from *lnop to end that match the search RE, or that
+ *	don't if invert is set, to a global command's ranges, scanning them
+ *	in parallel.  On return, *lnop is the first line that wasn't decided,
+ *	or the line after the last one scanned.  Lines that aren't worth
+ *	scanning in parallel, or can't be, aren't decided.  Returns 1 if
+ *	interrupted or on error.
+ *
+ * PUBLIC: int ps_mark(SCR *, recno_t *, recno_t, int, struct _rh *, busy_t *);
+ */
+int
+ps_mark(SCR *sp,
+    recno_t *lnop, recno_t end, int invert, struct _rh *rq, busy_t *btp)
+{
+#ifdef HAVE_PTHREAD
+	PSCAN ps;
+
+	memset(&ps, 0, sizeof(ps));
+	ps.mark = 1;
+	ps.invert = invert;
+	ps.rq = rq;
+	return (ps_scan(sp, &ps, lnop, end, btp));
+#else
+	return (0);
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+/*
+ * ps_scan --
+ *	Scan the lines from *lnop to end.
+ */
+static int
+ps_scan(SCR *sp, PSCAN *ps, recno_t *lnop, recno_t end, busy_t *btp)
+{
+	PSCHUNK *cp;
+	PSWORKER *workers, *wp;
+	recno_t lno;
+	u_long i, n, nworkers;
+	int rval;
+
+	if ((n = ps_threads(sp, *lnop, &end)) == 0)
+		return (0);
+
+	/* Compile the workers' RE's. */
+	rval = 0;
+	CALLOC_RET(sp, workers, n, sizeof(PSWORKER));
+	for (nworkers = 0; nworkers < n; ++nworkers) {
+		wp = &workers[nworkers];
+		wp->ps = ps;
+		if (regcomp(&wp->re, sp->re, sp->re_flags))
+			goto err1;
+	}
+
+	ps->sp = sp;
+	ps->stop = end + 1;
+	ps->nslots = n * PS_SLOTS;
+	CALLOC(sp, ps->chunks, ps->nslots, sizeof(PSCHUNK));
+	if (ps->chunks == NULL) {
+		rval = 1;
+		goto err1;
+	}
+	if (pthread_mutex_init(&ps->mtx, NULL))
+		goto err2;
+	if (pthread_cond_init(&ps->wcond, NULL))
+		goto err3;
+	if (pthread_cond_init(&ps->mcond, NULL))
+		goto err4;
+	(void)clock_gettime(CLOCK_REALTIME, &ps->poll);
+
+	/* Start the workers; if none start, scan the lines serially. */
+	for (n = 0; n < nworkers; ++n)
+		if (pthread_create(&workers[n].tid,
+		    NULL, ps_worker, &workers[n]))
+			break;
+	if (n == 0)
+		goto err5;
+
+	(void)pthread_mutex_lock(&ps->mtx);
+	for (lno = *lnop;;) {
+		if ((rval = ps_poll(sp, ps, btp)) != 0)
+			break;
+
+		/* Finish the scanned chunks, in order. */
+		for (; ps->ndone < ps->nput; ++ps->ndone) {
+			cp = &ps->chunks[ps->ndone % ps->nslots];
+			if (cp->busy)
+				break;
+			if (cp->lno < ps->stop &&
+			    (rval = ps_merge(sp, ps, cp)) != 0)
+				break;
+		}
+		if (rval != 0)
+			break;
+
+		/*
+		 * Queue the next chunk, if there's room, until there are no
+		 * more lines, or the scan stops before the next line.
+		 */
+		if (lno <= end && lno < ps->stop &&
+		    ps->nput - ps->ndone < ps->nslots) {
+			cp = &ps->chunks[ps->nput % ps->nslots];
+			(void)pthread_mutex_unlock(&ps->mtx);
+			rval = ps_fill(sp, cp, lno, end);
+			(void)pthread_mutex_lock(&ps->mtx);
+			if (rval != 0)
+				break;
+			if (cp->cnt == 0) {
+				end = lno - 1;
+				continue;
+			}
+			lno += cp->cnt;
+			cp->busy = 1;
+			++ps->nput;
+			(void)pthread_cond_signal(&ps->wcond);
+			continue;
+		}
+		if (ps->ndone == ps->nput && (lno > end || lno >= ps->stop))
+			break;
+		if ((rval = ps_wait(sp, ps, btp)) != 0)
+			break;
+	}
+
+	/* If interrupted, a stop at line 0 stops the workers scanning. */
+	if (rval != 0)
+		ps->stop = 0;
+	ps->eof = 1;
+	(void)pthread_cond_broadcast(&ps->wcond);
+	(void)pthread_mutex_unlock(&ps->mtx);
+	while (n > 0)
+		(void)pthread_join(workers[--n].tid, NULL);
+	if (rval == 0)
+		*lnop = MIN(lno, ps->stop);
+
+err5:	(void)pthread_cond_destroy(&ps->mcond);
+err4:	(void)pthread_cond_destroy(&ps->wcond);
+err3:	(void)pthread_mutex_destroy(&ps->mtx);
+err2:	for (i = 0; i < ps->nslots; ++i) {
+		free(ps->chunks[i].bp);
+		free(ps->chunks[i].runs);
+	}
+	free(ps->chunks);
+err1:	while (nworkers > 0) {
+		wp = &workers[--nworkers];
+		regfree(&wp->re);
+		free(wp->cw.bp1.c);
+	}
+	free(workers);
+	return (rval);
+}
+
+/*
+ * ps_threads --
+ *	Return the number of threads to scan the lines from lno to end with,
+ *	or 0 if they shouldn't be scanned in parallel.
+ */
+static u_long
+ps_threads(SCR *sp, recno_t lno, recno_t *endp)
+{
+	static u_long ncpu;
+	recno_t last;
+	long n;
+
+	/*
+	 * Lines being input are only available through db_get(), and lines
+	 * not yet loaded are only available a line at a time.
+	 */
+	if (O_VAL(sp, O_SEARCHTHREADS) == 1 || F_ISSET(sp, SC_TINPUT) ||
+	    !F_ISSET(sp, SC_RE_SEARCH) || sp->re == NULL ||
+	    db_loading(sp, &last) || !conv_mtsafe(sp))
+		return (0);
+
+	if (*endp == OOBLNO) {
+		if (db_last(sp, &last))
+			return (0);
+		*endp = last;
+	}
+	if (*endp < lno || *endp - lno < PS_MINLINES)
+		return (0);
+
+	if (O_VAL(sp, O_SEARCHTHREADS) != 0)
+		return (O_VAL(sp, O_SEARCHTHREADS));
+	if (ncpu == 0) {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+		ncpu = n < 1 ? 1 : MIN(n, PS_MAXTHREADS);
+	}
+	return (ncpu > 1 ? ncpu : 0);
+}
+
+/*
+ * ps_fill --
+ *	Fill a chunk with the lines starting at lno.
+ */
+static int
+ps_fill(SCR *sp, PSCHUNK *cp, recno_t lno, recno_t end)
+{
+	recno_t cnt, n;
+	size_t len, off;
+	char *p;
+
+	cp->lno = lno;
+	cp->cnt = 0;
+	cp->nruns = 0;
+
+	/*
+	 * Take a long run of lines in place.  Otherwise, copy lines, taking
+	 * short runs a run at a time, until the chunk is full or there's a
+	 * long run.  A line that can't be retrieved ends the chunk, and the
+	 * caller finds the problem when it gets to that line.
+	 */
+	for (cnt = MIN(end - lno + 1, PS_CHUNK), off = 0; cp->cnt < cnt;) {
+		if (db_rspan(sp, lno, cnt - cp->cnt, &p, &len, &n) || n == 0) {
+			if (db_rget(sp, lno, &p, &len))
+				break;
+			BINC_RETC(sp, cp->bp, cp->blen, off + len + 1);
+			memcpy(cp->bp + off, p, len);
+			cp->bp[off + len] = '\n';
+			off += len + 1;
+			++cp->cnt;
+			++lno;
+			continue;
+		}
+		if (n >= MIN(PS_SPANMIN, cnt - cp->cnt)) {
+			if (cp->cnt != 0)
+				break;
+			cp->p = p;
+			cp->len = len;
+			cp->cnt = n;
+			return (0);
+		}
+		BINC_RETC(sp, cp->bp, cp->blen, off + len);
+		memcpy(cp->bp + off, p, len);
+		off += len;
+		cp->cnt += n;
+		lno += n;
+	}
+	cp->p = cp->bp;
+	cp->len = off;
+	return (0);
+}
+
+/*
+ * ps_merge --
+ *	Append a chunk's marked runs of lines to the global command's ranges.
+ */
+static int
+ps_merge(SCR *sp, PSCAN *ps, PSCHUNK *cp)
+{
+	PSRUN *runp;
+	RANGE *rp;
+	size_t i;
+
+	for (i = 0, runp = cp->runs; i < cp->nruns; ++i, ++runp) {
+		/* If follows the last entry, extend the last entry's range. */
+		if ((rp = TAILQ_LAST(ps->rq, _rh)) != NULL &&
+		    rp->stop == runp->start - 1) {
+			rp->stop = runp->stop;
+			continue;
+		}
+
+		/* Allocate a new range, and append it to the list. */
+		CALLOC(sp, rp, 1, sizeof(RANGE));
+		if (rp == NULL)
+			return (1);
+		rp->start = runp->start;
+		rp->stop = runp->stop;
+		TAILQ_INSERT_TAIL(ps->rq, rp, q);
+	}
+	return (0);
+}
+
+/*
+ * ps_poll --
+ *	Check for interrupts and typed keys, and update the busy message,
+ *	if it's time.
+ *	Called, and returns, with the lock held.
+ */
+static int
+ps_poll(SCR *sp, PSCAN *ps, busy_t *btp)
+{
+	struct timespec now;
+	int rval;
+
+	(void)clock_gettime(CLOCK_REALTIME, &now);
+	if (now.tv_sec < ps->poll.tv_sec ||
+	    (now.tv_sec == ps->poll.tv_sec && now.tv_nsec < ps->poll.tv_nsec))
+		return (0);
+	ps->poll = now;
+	if ((ps->poll.tv_nsec += PS_POLL * 1000000) >= 1000000000) {
+		ps->poll.tv_nsec -= 1000000000;
+		++ps->poll.tv_sec;
+	}
+
+	(void)pthread_mutex_unlock(&ps->mtx);
+	if ((rval = INTERRUPTED(sp)) == 0 && ps->keys != NULL)
+		rval = search_keys(sp, ps->keys);
+	if (rval == 0 && btp != NULL) {
+		search_busy(sp, *btp);
+		*btp = BUSY_UPDATE;
+	}
+	(void)pthread_mutex_lock(&ps->mtx);
+	return (rval);
+}
+
+/*
+ * ps_wait --
+ *	Wait for a worker to finish a chunk.  Called, and returns, with the
+ *	lock held.
+ */
+static int
+ps_wait(SCR *sp, PSCAN *ps, busy_t *btp)
+{
+	if (pthread_cond_timedwait(&ps->mcond, &ps->mtx, &ps->poll) == 0)
+		return (0);
+	return (ps_poll(sp, ps, btp));
+}
+
+/*
+ * ps_worker --
+ *	Scan queued chunks.
+ */
+static void *
+ps_worker(void *arg)
+{
+	PSWORKER *wp = arg;
+	PSCAN *ps = wp->ps;
+	PSCHUNK *cp;
+	recno_t end, lno, n;
+	int match;
+	char *p, *t;
+
+	(void)pthread_mutex_lock(&ps->mtx);
+	for (;;) {
+		while (ps->nget == ps->nput && !ps->eof)
+			(void)pthread_cond_wait(&ps->wcond, &ps->mtx);
+		if (ps->nget == ps->nput)
+			break;
+		cp = &ps->chunks[ps->nget++ % ps->nslots];
+
+		/* Recheck where the scan stops every PS_CHECK lines. */
+		for (lno = cp->lno, end = lno + cp->cnt, p = cp->p;
+		    lno < end && lno < ps->stop;) {
+			n = MIN(end - lno, PS_CHECK);
+			(void)pthread_mutex_unlock(&ps->mtx);
+			for (; n > 0; --n, ++lno, p = t + 1) {
+				t = memchr(p, '\n', cp->p + cp->len - p);
+				if ((match = ps_line(ps->sp, wp, p, t - p)) < 0)
+					break;
+				if (!ps->mark) {
+					if (match)
+						break;
+				} else if (match != ps->invert &&
+				    ps_run(cp, lno))
+					break;
+			}
+			(void)pthread_mutex_lock(&ps->mtx);
+			if (n != 0) {
+				if (ps->stop > lno)
+					ps->stop = lno;
+				break;
+			}
+		}
+		cp->busy = 0;
+		(void)pthread_cond_signal(&ps->mcond);
+	}
+	(void)pthread_mutex_unlock(&ps->mtx);
+	return (NULL);
+}
+
+/*
+ * ps_line --
+ *	Return 1 if a line matches, 0 if it doesn't, and -1 if it can't be
+ *	decided.
+ */
+static int
+ps_line(SCR *sp, PSWORKER *wp, char *p, size_t len)
+{
+	regmatch_t match[1];
+	size_t wlen;
+	CHAR_T *wl;
+
+	if (FILE2INT5(sp, wp->cw, p, len, wl, wlen))
+		return (-1);
+	match[0].rm_so = 0;
+	match[0].rm_eo = wlen;
+	switch (regexec(&wp->re, wl, 1, match, REG_STARTEND)) {
+	case 0:
+		return (1);
+	case REG_NOMATCH:
+		return (0);
+	default:
+		return (-1);
+	}
+	/* NOTREACHED */
+}
+
+/*
+ * ps_run --
+ *	Add a line to a chunk's marked runs of lines.
+ */
+static int
+ps_run(PSCHUNK *cp, recno_t lno)
+{
+	PSRUN *runs;
+
+	if (cp->nruns != 0 && cp->runs[cp->nruns - 1].stop == lno - 1) {
+		cp->runs[cp->nruns - 1].stop = lno;
+		return (0);
+	}
+	if (cp->nruns == cp->runslen) {
+		if ((runs = realloc(cp->runs,
+		    (cp->runslen + 64) * sizeof(PSRUN))) == NULL)
+			return (1);
+		cp->runs = runs;
+		cp->runslen += 64;
+	}
+	cp->runs[cp->nruns].start = cp->runs[cp->nruns].stop = lno;
+	++cp->nruns;
+	return (0);
+}
+#endif
@@ -33,7 +33,7 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
 {
 	CHAR_T name;
 	TEXT *ltp, *tp;
-	recno_t lno;
+	recno_t cnt, lno;
 	size_t blen, clen, len;
 	int rval;
 	CHAR_T *bp, *t;
@@ -77,10 +77,11 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
 		if (db_last(sp, &lno))
 			return (1);
 		if (lno == 0) {
-			for (; tp != NULL;
-			    ++lno, ++sp->rptlines[L_ADDED], tp = TAILQ_NEXT(tp, q))
-				if (db_append(sp, 1, lno, tp->lb, tp->len))
-					return (1);
+			for (cnt = 0, ltp = tp; ltp != NULL;
+			    ++cnt, ltp = TAILQ_NEXT(ltp, q));
+			if (db_append_lines(sp, 1, lno, tp, cnt))
+				return (1);
+			sp->rptlines[L_ADDED] += cnt;
 			rp->lno = 1;
 			rp->cno = 0;
 			return (0);
@@ -91,10 +92,11 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
 	if (F_ISSET(cbp, CB_LMODE)) {
 		lno = append ? cp->lno : cp->lno - 1;
 		rp->lno = lno + 1;
-		for (; tp != NULL;
-		    ++lno, ++sp->rptlines[L_ADDED], tp = TAILQ_NEXT(tp, q))
-			if (db_append(sp, 1, lno, tp->lb, tp->len))
-				return (1);
+		for (cnt = 0, ltp = tp; ltp != NULL;
+		    ++cnt, ltp = TAILQ_NEXT(ltp, q));
+		if (db_append_lines(sp, 1, lno, tp, cnt))
+			return (1);
+		sp->rptlines[L_ADDED] += cnt;
 		rp->cno = 0;
 		(void)nonblank(sp, rp->lno, &rp->cno);
 		return (0);
@@ -204,10 +206,13 @@ put(SCR *sp, CB *cbp, CHAR_T *namep, MARK *cp, MARK *rp, int append)
 		}
 
 		/* Output any intermediate lines in the CB. */
-		for (tp = TAILQ_NEXT(tp, q); TAILQ_NEXT(tp, q) != NULL;
-		    ++lno, ++sp->rptlines[L_ADDED], tp = TAILQ_NEXT(tp, q))
-			if (db_append(sp, 1, lno, tp->lb, tp->len))
-				goto err;
+		tp = TAILQ_NEXT(tp, q);
+		for (cnt = 0, ltp = tp; TAILQ_NEXT(ltp, q) != NULL;
+		    ++cnt, ltp = TAILQ_NEXT(ltp, q));
+		if (db_append_lines(sp, 1, lno, tp, cnt))
+			goto err;
+		lno += cnt;
+		sp->rptlines[L_ADDED] += cnt;
 
 		if (db_append(sp, 1, lno, t, clen))
 			goto err;
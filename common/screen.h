@@ -115,17 +115,20 @@ struct _scr {
 #define	SEARCH_EOL	0x0002		/* Offset past EOL is okay. */
 #define	SEARCH_FILE	0x0004		/* Search the entire file. */
 #define	SEARCH_INCR	0x0008		/* Search incrementally. */
-#define	SEARCH_MSG	0x0010		/* Display search messages. */
-#define	SEARCH_PARSE	0x0020		/* Parse the search pattern. */
-#define	SEARCH_SET	0x0040		/* Set search direction. */
-#define	SEARCH_TAG	0x0080		/* Search for a tag pattern. */
-#define	SEARCH_WMSG	0x0100		/* Display search-wrapped messages. */
+#define	SEARCH_KEYS	0x0010		/* Stop if a key is typed. */
+#define	SEARCH_MSG	0x0020		/* Display search messages. */
+#define	SEARCH_PARSE	0x0040		/* Parse the search pattern. */
+#define	SEARCH_SET	0x0080		/* Set search direction. */
+#define	SEARCH_TAG	0x0100		/* Search for a tag pattern. */
+#define	SEARCH_WMSG	0x0200		/* Display search-wrapped messages. */
 
 					/* Ex/vi: RE information. */
 	dir_t	 searchdir;		/* Last file search direction. */
+	recno_t	 isrch_lno;		/* Incremental search: starting line. */
 	regex_t	 re_c;			/* Search RE: compiled form. */
 	CHAR_T	*re;			/* Search RE: uncompiled form. */
 	size_t	 re_len;		/* Search RE: uncompiled length. */
+	int	 re_flags;		/* Search RE: regcomp flags. */
 	regex_t	 subre_c;		/* Substitute RE: compiled form. */
 	CHAR_T	*subre;			/* Substitute RE: uncompiled form. */
 	size_t	 subre_len;		/* Substitute RE: uncompiled length). */
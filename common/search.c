@@ -140,8 +140,9 @@ int
 f_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
     CHAR_T **eptrn, u_int flags)
 {
+	struct timespec ts, *tsp;
 	busy_t btype;
-	recno_t lno;
+	recno_t elno, lno;
 	regmatch_t match[1];
 	size_t coff, len;
 	int cnt, eval, rval, wrapped = 0;
@@ -189,10 +190,26 @@ f_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 			coff = fm->cno + 1;
 	}
 
+	/*
+	 * A search ends at the starting line, once it wraps.  An incremental
+	 * search continuing from a previous match ends at the line where the
+	 * incremental search started, the lines in between are known not to
+	 * match, see txt_isrch().  If that line follows the starting line,
+	 * the search ends without wrapping.
+	 */
+	elno = LF_ISSET(SEARCH_INCR) ? sp->isrch_lno : fm->lno;
+
+	if (LF_ISSET(SEARCH_KEYS)) {
+		tsp = &ts;
+		timepoint_steady(tsp);
+	} else
+		tsp = NULL;
+
 	btype = BUSY_ON;
 	for (cnt = INTERRUPT_CHECK, rval = 1;; ++lno, coff = 0) {
 		if (cnt-- == 0) {
-			if (INTERRUPTED(sp))
+			if (INTERRUPTED(sp) ||
+			    (tsp != NULL && search_keys(sp, tsp)))
 				break;
 			if (LF_ISSET(SEARCH_MSG)) {
 				search_busy(sp, btype);
@@ -200,8 +217,18 @@ f_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 			}
 			cnt = INTERRUPT_CHECK;
 		}
-		if ((wrapped && lno > fm->lno) || db_get(sp, lno, 0, &l, &len)) {
-			if (wrapped) {
+
+		/*
+		 * Skip runs of whole lines that don't match, scanning them in
+		 * parallel if the file is large enough, see pscan.c.
+		 */
+		if (coff == 0 && ps_search(sp, &lno,
+		    wrapped || elno > fm->lno ? elno : OOBLNO,
+		    LF_ISSET(SEARCH_MSG) ? &btype : NULL, tsp))
+			break;
+		if (((wrapped || elno > fm->lno) && lno > elno) ||
+		    db_get(sp, lno, 0, &l, &len)) {
+			if (wrapped || elno > fm->lno) {
 				if (LF_ISSET(SEARCH_MSG))
 					search_msg(sp, S_NOTFOUND);
 				break;
@@ -281,10 +308,11 @@ int
 b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
     CHAR_T **eptrn, u_int flags)
 {
+	struct timespec ts, *tsp;
 	busy_t btype;
-	recno_t lno;
+	recno_t elno, lno;
 	regmatch_t match[1];
-	size_t coff, last, len;
+	size_t coff, len;
 	int cnt, eval, rval, wrapped;
 	CHAR_T *l;
 
@@ -317,10 +345,20 @@ b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 		coff = fm->cno;
 	}
 
+	/* See comment in f_search(). */
+	elno = LF_ISSET(SEARCH_INCR) ? sp->isrch_lno : fm->lno;
+
+	if (LF_ISSET(SEARCH_KEYS)) {
+		tsp = &ts;
+		timepoint_steady(tsp);
+	} else
+		tsp = NULL;
+
 	btype = BUSY_ON;
 	for (cnt = INTERRUPT_CHECK, rval = 1, wrapped = 0;; --lno, coff = 0) {
 		if (cnt-- == 0) {
-			if (INTERRUPTED(sp))
+			if (INTERRUPTED(sp) ||
+			    (tsp != NULL && search_keys(sp, tsp)))
 				break;
 			if (LF_ISSET(SEARCH_MSG)) {
 				search_busy(sp, btype);
@@ -328,8 +366,8 @@ b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 			}
 			cnt = INTERRUPT_CHECK;
 		}
-		if ((wrapped && lno < fm->lno) || lno == 0) {
-			if (wrapped) {
+		if (((wrapped || elno < fm->lno) && lno < elno) || lno == 0) {
+			if (wrapped || elno < fm->lno) {
 				if (LF_ISSET(SEARCH_MSG))
 					search_msg(sp, S_NOTFOUND);
 				break;
@@ -354,8 +392,16 @@ b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 		if (db_get(sp, lno, 0, &l, &len))
 			break;
 
-		/* Set the termination. */
-		match[0].rm_so = 0;
+		/*
+		 * Set the termination.  REG_BACKWARD finds the match on the
+		 * line that starts last, and, if the cursor is on the line,
+		 * it must start before the cursor.  Historically, the line was
+		 * stepped through a match at a time, and the walk ended at a
+		 * match that starts on the last character, so a match that
+		 * starts at the end of the line is only used if there's no
+		 * match starting on the last character.
+		 */
+		match[0].rm_so = coff != 0 && coff <= len ? coff - 1 : len;
 		match[0].rm_eo = len;
 
 #if defined(DEBUG) && 0
@@ -363,7 +409,18 @@ b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 #endif
 		/* Search the line. */
 		eval = regexec(&sp->re_c, l, 1, match,
-		    (match[0].rm_eo == len ? 0 : REG_NOTEOL) | REG_STARTEND);
+		    REG_BACKWARD | REG_STARTEND);
+		if (eval == 0 && match[0].rm_so == len && len != 0) {
+			match[0].rm_so = len - 1;
+			match[0].rm_eo = len;
+			eval = regexec(&sp->re_c, l, 1, match,
+			    REG_BACKWARD | REG_STARTEND);
+			if (eval == REG_NOMATCH ||
+			    (eval == 0 && match[0].rm_so != len - 1)) {
+				match[0].rm_so = len;
+				eval = 0;
+			}
+		}
 		if (eval == REG_NOMATCH)
 			continue;
 		if (eval != 0) {
@@ -374,10 +431,6 @@ b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 			break;
 		}
 
-		/* Check for a match starting past the cursor. */
-		if (coff != 0 && match[0].rm_so >= coff)
-			continue;
-
 		/* Warn if the search wrapped. */
 		if (wrapped && LF_ISSET(SEARCH_WMSG))
 			search_msg(sp, S_WRAP);
@@ -386,44 +439,18 @@ b_search(SCR *sp, MARK *fm, MARK *rm, CHAR_T *ptrn, size_t plen,
 		TRACE(sp, "B found: %qu to %qu\n",
 		    match[0].rm_so, match[0].rm_eo);
 #endif
-		/*
-		 * We now have the first match on the line.  Step through the
-		 * line character by character until find the last acceptable
-		 * match.  This is painful, we need a better interface to regex
-		 * to make this work.
-		 */
-		for (;;) {
-			last = match[0].rm_so++;
-			if (match[0].rm_so >= len)
-				break;
-			match[0].rm_eo = len;
-			eval = regexec(&sp->re_c, l, 1, match,
-			    (match[0].rm_so == 0 ? 0 : REG_NOTBOL) |
-			    REG_STARTEND);
-			if (eval == REG_NOMATCH)
-				break;
-			if (eval != 0) {
-				if (LF_ISSET(SEARCH_MSG))
-					re_error(sp, eval, &sp->re_c);
-				else
-					(void)sp->gp->scr_bell(sp);
-				goto err;
-			}
-			if (coff && match[0].rm_so >= coff)
-				break;
-		}
 		rm->lno = lno;
 
 		/* See comment in f_search(). */
-		if (!LF_ISSET(SEARCH_EOL) && last >= len)
+		if (!LF_ISSET(SEARCH_EOL) && match[0].rm_so >= len)
 			rm->cno = len != 0 ? len - 1 : 0;
 		else
-			rm->cno = last;
+			rm->cno = match[0].rm_so;
 		rval = 0;
 		break;
 	}
 
-err:	if (LF_ISSET(SEARCH_MSG))
+	if (LF_ISSET(SEARCH_MSG))
 		search_busy(sp, BUSY_OFF);
 	return (rval);
 }
@@ -461,6 +488,37 @@ search_msg(SCR *sp, smsg_t msg)
 	}
 }
 
+/*
+ * search_keys --
+ *	Return if a key has been typed, checking the terminal no more often
+ *	than every 1/20 of a second.  Searches the user can type ahead of,
+ *	e.g., incremental searches, give up when that happens.
+ *
+ * PUBLIC: int search_keys(SCR *, struct timespec *);
+ */
+int
+search_keys(SCR *sp, struct timespec *tsp)
+{
+	struct timespec ts, ts_diff;
+	const struct timespec ts_min = { 0, 50000000 };
+
+	if (KEYS_WAITING(sp))
+		return (1);
+
+	timepoint_steady(&ts);
+	ts_diff = ts;
+	timespecsub(&ts_diff, tsp);
+	if (timespeccmp(&ts_diff, &ts_min, <))
+		return (0);
+	*tsp = ts;
+
+	/*
+	 * Wait the shortest time possible, a timeout of 0 waits forever.
+	 * Any characters read are queued for the caller's next read.
+	 */
+	return (v_event_get(sp, NULL, 1, EC_TIMEOUT) || KEYS_WAITING(sp));
+}
+
 /*
  * search_busy --
  *	Put up the busy searching message.
@@ -149,8 +149,8 @@ EXCMDLIST const cmds[] = {
 /* C_DISPLAY */
 	{L("display"),	ex_display,	0,
 	    "w1r",
-	    "display b[uffers] | c[onnections] | s[creens] | t[ags]",
-	    "display buffers, connections, screens or tags"},
+	    "display b[uffers] | c[onnections] | l[ines] | r[egex] | s[creens] | t[ags] | u[ndo] | w[rites]",
+	    "display buffers, connections, line or RE cache, screens, tags, undo or writes"},
 /* C_EDIT */
 	{L("edit"),	ex_edit,	E_NEWSCREEN,
 	    "f1o",
@@ -25,11 +25,17 @@
 static int	is_prefix(ARGS *, CHAR_T *);
 static int	bdisplay(SCR *);
 static void	db(SCR *, CB *, const char *);
+static int	ldisplay(SCR *);
+static int	rdisplay(SCR *);
+static int	udisplay(SCR *);
+static int	wdisplay(SCR *);
 
 /*
- * ex_display -- :display b[uffers] | c[onnections] | s[creens] | t[ags]
+ * ex_display -- :display b[uffers] | c[onnections] | l[ines] | r[egex] |
+ *		     s[creens] | t[ags] | u[ndo] | w[rites]
  *
- *	Display cscope connections, buffers, tags or screens.
+ *	Display cscope connections, buffers, line cache, RE cache, tags,
+ *	screens, undo log or write statistics.
  *
  * PUBLIC: int ex_display(SCR *, EXCMD *);
  */
@@ -49,6 +55,14 @@ ex_display(SCR *sp, EXCMD *cmdp)
 		if (!is_prefix(arg, L("connections")))
 			break;
 		return (cscope_display(sp));
+	case 'l':
+		if (!is_prefix(arg, L("lines")))
+			break;
+		return (ldisplay(sp));
+	case 'r':
+		if (!is_prefix(arg, L("regex")))
+			break;
+		return (rdisplay(sp));
 	case 's':
 		if (!is_prefix(arg, L("screens")))
 			break;
@@ -57,6 +71,14 @@ ex_display(SCR *sp, EXCMD *cmdp)
 		if (!is_prefix(arg, L("tags")))
 			break;
 		return (ex_tag_display(sp));
+	case 'u':
+		if (!is_prefix(arg, L("undo")))
+			break;
+		return (udisplay(sp));
+	case 'w':
+		if (!is_prefix(arg, L("writes")))
+			break;
+		return (wdisplay(sp));
 	}
 	ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
 	return (1);
@@ -112,6 +134,99 @@ bdisplay(SCR *sp)
 	return (0);
 }
 
+/*
+ * ldisplay --
+ *
+ *	Display the line cache statistics.
+ */
+static int
+ldisplay(SCR *sp)
+{
+	EXF *ep;
+
+	if ((ep = sp->ep) == NULL) {
+		ex_emsg(sp, NULL, EXM_NOFILEYET);
+		return (1);
+	}
+	(void)ex_printf(sp,
+	    "line cache: %lu of %lu lines, %lu hits, %lu misses\n",
+	    (u_long)ep->c_cnt, (u_long)ep->c_size, ep->c_hits, ep->c_misses);
+	return (0);
+}
+
+/*
+ * rdisplay --
+ *
+ *	Display the compiled RE cache statistics.
+ */
+static int
+rdisplay(SCR *sp)
+{
+	GS *gp;
+
+	gp = sp->gp;
+	(void)ex_printf(sp,
+	    "RE cache: %lu of %lu RE's, %lu hits, %lu misses\n",
+	    gp->re_cnt, O_VAL(sp, O_RECACHE), gp->re_hits, gp->re_misses);
+	return (0);
+}
+
+/*
+ * udisplay --
+ *
+ *	Display the undo log statistics.
+ */
+static int
+udisplay(SCR *sp)
+{
+	EXF *ep;
+	u_long changes, records;
+	size_t largest;
+
+	if ((ep = sp->ep) == NULL) {
+		ex_emsg(sp, NULL, EXM_NOFILEYET);
+		return (1);
+	}
+	if (log_stats(sp, &changes, &records, &largest))
+		return (1);
+	(void)ex_printf(sp,
+	    "undo log: %lu changes, %lu records, %lu bytes, %lu in memory, "
+	    "largest change %lu bytes, %lu evictions, %lu bytes evicted\n",
+	    changes, records, (u_long)(ep->l_high - ep->l_base),
+	    (u_long)ep->l_mem, (u_long)largest, ep->l_evicts, ep->l_evbytes);
+	if (ep->l_hdr != NULL)
+		(void)ex_printf(sp, "undo file: %lu bytes not yet read\n",
+		    (u_long)(ep->l_hdr->cur - ep->l_hdr->base));
+	return (0);
+}
+
+/*
+ * wdisplay --
+ *
+ *	Display the statistics of the last write of the file.
+ */
+static int
+wdisplay(SCR *sp)
+{
+	EXF *ep;
+	u_long msec;
+
+	if ((ep = sp->ep) == NULL) {
+		ex_emsg(sp, NULL, EXM_NOFILEYET);
+		return (1);
+	}
+	msec = ep->w_time.tv_sec * 1000 + ep->w_time.tv_nsec / 1000000;
+	(void)ex_printf(sp,
+	    "last write: %lu lines, %lu bytes, %lu.%03lu seconds, %lu KB/s, ",
+	    ep->w_lines, ep->w_bytes, msec / 1000, msec % 1000,
+	    ep->w_bytes / 1024 * 1000 / (msec == 0 ? 1 : msec));
+	if (ep->w_calls == 0)
+		(void)ex_printf(sp, "stdio\n");
+	else
+		(void)ex_printf(sp, "%lu writev calls\n", ep->w_calls);
+	return (0);
+}
+
 /*
  * db --
  *	Display a buffer.
@@ -193,16 +193,21 @@ usage:		ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
 	for (start = cmdp->addr1.lno,
 	    end = cmdp->addr2.lno; start <= end; ++start) {
 		if (cnt-- == 0) {
-			if (INTERRUPTED(sp)) {
-				SLIST_REMOVE_HEAD(sp->gp->ecq, q);
-				free(ecp->cp);
-				free(ecp);
-				break;
-			}
+			if (INTERRUPTED(sp))
+				goto intr;
 			search_busy(sp, btype);
 			btype = BUSY_UPDATE;
 			cnt = INTERRUPT_CHECK;
 		}
+
+		/*
+		 * Mark runs of lines in parallel if there are enough of them,
+		 * see pscan.c.
+		 */
+		if (ps_mark(sp, &start, end, cmd == V, ecp->rq, &btype))
+			goto intr;
+		if (start > end)
+			break;
 		if (db_get(sp, start, DBG_FATAL, &dbp, &len))
 			return (1);
 		match[0].rm_so = 0;
@@ -236,18 +241,27 @@ usage:		ex_emsg(sp, cmdp->cmd->usage, EXM_USAGE);
 		rp->start = rp->stop = start;
 		TAILQ_INSERT_TAIL(ecp->rq, rp, q);
 	}
+	if (0) {
+intr:		SLIST_REMOVE_HEAD(sp->gp->ecq, q);
+		while ((rp = TAILQ_FIRST(ecp->rq)) != NULL) {
+			TAILQ_REMOVE(ecp->rq, rp, q);
+			free(rp);
+		}
+		free(ecp->cp);
+		free(ecp);
+	}
 	search_busy(sp, BUSY_OFF);
 	return (0);
 }
 
 /*
  * ex_g_insdel --
- *	Update the ranges based on an insertion or deletion.
+ *	Update the ranges based on an insertion or deletion of cnt lines.
  *
- * PUBLIC: int ex_g_insdel(SCR *, lnop_t, recno_t);
+ * PUBLIC: int ex_g_insdel(SCR *, lnop_t, recno_t, recno_t);
  */
 int
-ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
+ex_g_insdel(SCR *sp, lnop_t op, recno_t lno, recno_t cnt)
 {
 	EXCMD *ecp;
 	RANGE *nrp, *rp;
@@ -269,15 +283,22 @@ ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
 			
 			/*
 			 * If range greater than the line, decrement or
-			 * increment the range.
+			 * increment the range.  A range starting inside
+			 * deleted lines starts at the line after them.
 			 */
 			if (rp->start > lno) {
 				if (op == LINE_DELETE) {
-					--rp->start;
-					--rp->stop;
+					rp->start = rp->start - lno < cnt ?
+					    lno : rp->start - cnt;
+					rp->stop = rp->stop - lno < cnt ?
+					    lno - 1 : rp->stop - cnt;
+					if (rp->start > rp->stop) {
+						TAILQ_REMOVE(ecp->rq, rp, q);
+						free(rp);
+					}
 				} else {
-					++rp->start;
-					++rp->stop;
+					rp->start += cnt;
+					rp->stop += cnt;
 				}
 				continue;
 			}
@@ -289,7 +310,9 @@ ex_g_insdel(SCR *sp, lnop_t op, recno_t lno)
 			 * element, neither range can be exhausted.
 			 */
 			if (op == LINE_DELETE) {
-				if (rp->start > --rp->stop) {
+				rp->stop = rp->stop - lno < cnt ?
+				    lno - 1 : rp->stop - cnt;
+				if (rp->start > rp->stop) {
 					TAILQ_REMOVE(ecp->rq, rp, q);
 					free(rp);
 				}
@@ -150,9 +150,10 @@ ex_join(SCR *sp, EXCMD *cmdp)
 	sp->lno = cmdp->addr1.lno;
 
 	/* Delete the joined lines. */
-	for (from = cmdp->addr1.lno, to = cmdp->addr2.lno; to > from; --to)
-		if (db_delete(sp, to))
-			goto err;
+	from = cmdp->addr1.lno;
+	if (cmdp->addr2.lno > from &&
+	    db_delete_lines(sp, from + 1, cmdp->addr2.lno - from))
+		goto err;
 
 	/* If the original line changed, reset it. */
 	if (!first && db_set(sp, from, bp, tbp - bp)) {
@@ -24,6 +24,12 @@
 #include "../common/common.h"
 #include "../vi/vi.h"
 
+/* Lines appended to the file at a time by ex_readfp. */
+#define	READ_BATCH	1024
+/* Bytes read, and <newline>s found, at a time by ex_readfp. */
+#define	READ_BLKSIZE	(64 * 1024)
+#define	READ_NLINES	256
+
 /*
  * ex_read --	:read [file]
  *		:read [!cmd]
@@ -293,11 +299,14 @@ ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp, int silent)
 {
 	EX_PRIVATE *exp;
 	GS *gp;
-	recno_t lcnt, lno;
-	size_t len;
+	TEXTH tiq = TAILQ_HEAD_INITIALIZER(tiq);
+	TEXT *tp;
+	recno_t bcnt, lcnt, lno;
+	size_t blen, len, off, sbase, soff, nr;
+	size_t ni, nn, nls[READ_NLINES];
 	u_long ccnt;			/* XXX: can't print off_t portably. */
-	int nf, rval;
-	char *p;
+	int eof, nf, rval;
+	char *lp, *p;
 	size_t wlen;
 	CHAR_T *wp;
 
@@ -306,12 +315,62 @@ ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp, int silent)
 
 	/*
 	 * Add in the lines from the output.  Insertion starts at the line
-	 * following the address.
+	 * following the address.  The lines are collected into batches of
+	 * READ_BATCH lines, and the TEXT structures holding them are reused
+	 * by the following batches.
+	 *
+	 * The file is read a block at a time into the input buffer, and the
+	 * block scanned for <newline>s, so the lines are copied once, from
+	 * the buffer.  A line that crosses the end of the block is moved to
+	 * the front of the buffer before the next block is read.
 	 */
 	ccnt = 0;
 	lcnt = 0;
+	bcnt = 0;
+	tp = NULL;
+	blen = off = soff = sbase = 0;
+	ni = nn = 0;
+	eof = 0;
 	p = "147|Reading...";
-	for (lno = fm->lno; !ex_getline(sp, fp, &len); ++lno, ++lcnt) {
+	for (lno = fm->lno;; ++lcnt) {
+		while (ni == nn) {
+			ni = 0;
+			if ((nn = nl_scan(exp->ibp + soff,
+			    blen - soff, nls, READ_NLINES)) != 0) {
+				sbase = soff;
+				soff += nls[nn - 1];
+				break;
+			}
+			soff = blen;
+			if (eof)
+				break;
+			if (off != 0) {
+				memmove(exp->ibp, exp->ibp + off, blen - off);
+				blen -= off;
+				soff = blen;
+				off = 0;
+			}
+			BINC_GOTOC(sp,
+			    exp->ibp, exp->ibp_len, blen + READ_BLKSIZE);
+			errno = 0;
+			nr = fread(exp->ibp + blen, 1, exp->ibp_len - blen, fp);
+			blen += nr;
+			if (ferror(fp) && errno == EINTR)
+				clearerr(fp);
+			else if (nr == 0)
+				eof = 1;
+		}
+		if (ni < nn) {
+			lp = exp->ibp + off;
+			len = sbase + nls[ni] - off - 1;
+			off = sbase + nls[ni++];
+		} else if (off < blen) {
+			/* The last line doesn't end with a <newline>. */
+			lp = exp->ibp + off;
+			len = blen - off;
+			off = blen;
+		} else
+			break;
 		if ((lcnt + 1) % INTERRUPT_CHECK == 0) {
 			if (INTERRUPTED(sp))
 				break;
@@ -321,11 +380,30 @@ ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp, int silent)
 				p = NULL;
 			}
 		}
-		FILE2INT5(sp, exp->ibcw, exp->ibp, len, wp, wlen);
-		if (db_append(sp, 1, lno, wp, wlen))
-			goto err;
+		FILE2INT5(sp, exp->ibcw, lp, len, wp, wlen);
+		tp = tp == NULL ? TAILQ_FIRST(&tiq) : TAILQ_NEXT(tp, q);
+		if (tp == NULL) {
+			if ((tp = text_init(sp, wp, wlen, wlen)) == NULL)
+				goto err;
+			TAILQ_INSERT_TAIL(&tiq, tp, q);
+		} else {
+			BINC_GOTOW(sp, tp->lb, tp->lb_len, wlen);
+			MEMCPY(tp->lb, wp, wlen);
+			tp->len = wlen;
+		}
 		ccnt += len;
+		if (++bcnt == READ_BATCH) {
+			if (db_append_lines(sp,
+			    1, lno, TAILQ_FIRST(&tiq), bcnt))
+				goto err;
+			lno += bcnt;
+			bcnt = 0;
+			tp = NULL;
+		}
 	}
+	if (bcnt != 0 &&
+	    db_append_lines(sp, 1, lno, TAILQ_FIRST(&tiq), bcnt))
+		goto err;
 
 	if (ferror(fp) || fclose(fp))
 		goto err;
@@ -345,11 +423,13 @@ ex_readfp(SCR *sp, char *name, FILE *fp, MARK *fm, recno_t *nlinesp, int silent)
 
 	rval = 0;
 	if (0) {
+alloc_err:
 err:		msgq_str(sp, M_SYSERR, name, "%s");
 		(void)fclose(fp);
 		rval = 1;
 	}
 
+	text_lfree(&tiq);
 	if (!silent)
 		gp->scr_busy(sp, NULL, BUSY_OFF);
 	return (rval);
@@ -28,6 +28,7 @@
 #define	SUB_FIRST	0x01		/* The 'r' flag isn't reasonable. */
 #define	SUB_MUSTSETR	0x02		/* The 'r' flag is required. */
 
+static int re_cache(SCR *, CHAR_T *, size_t, int, regex_t *);
 static int re_conv(SCR *, CHAR_T **, size_t *, int *);
 static int re_cscope_conv(SCR *, CHAR_T **, size_t *, int *);
 static int re_sub(SCR *,
@@ -900,11 +901,11 @@ re_compile(SCR *sp, CHAR_T *ptrn, size_t plen, CHAR_T **ptrnp, size_t *lenp, reg
 
 	/* If we're replacing a saved value, clear the old one. */
 	if (LF_ISSET(RE_C_SEARCH) && F_ISSET(sp, SC_RE_SEARCH)) {
-		regfree(&sp->re_c);
+		re_free(sp, &sp->re_c);
 		F_CLR(sp, SC_RE_SEARCH);
 	}
 	if (LF_ISSET(RE_C_SUBST) && F_ISSET(sp, SC_RE_SUBST)) {
-		regfree(&sp->subre_c);
+		re_free(sp, &sp->subre_c);
 		F_CLR(sp, SC_RE_SUBST);
 	}
 
@@ -967,20 +968,134 @@ re_compile(SCR *sp, CHAR_T *ptrn, size_t plen, CHAR_T **ptrnp, size_t *lenp, reg
 	 * Regcomp isn't 8-bit clean, so we just lost if the pattern
 	 * contained a nul.  Bummer!
 	 */
-	if ((rval = regcomp(rep, ptrn, /* plen, */ reflags)) != 0) {
+	if ((rval = re_cache(sp, ptrn, plen, reflags, rep)) != 0) {
 		if (!LF_ISSET(RE_C_SILENT))
 			re_error(sp, rval, rep); 
 		return (1);
 	}
 
-	if (LF_ISSET(RE_C_SEARCH))
+	if (LF_ISSET(RE_C_SEARCH)) {
 		F_SET(sp, SC_RE_SEARCH);
+		sp->re_flags = reflags;
+	}
 	if (LF_ISSET(RE_C_SUBST))
 		F_SET(sp, SC_RE_SUBST);
 
 	return (0);
 }
 
+/*
+ * re_cache --
+ *	Compile the RE, reusing a previously compiled copy of it if there
+ *	is one.
+ *
+ * Searches, substitutes, global commands and tag searches all compile
+ * their RE's through re_compile, and alternating between a few of them
+ * (or substituting, which compiles the same RE as both the search and
+ * the substitute RE) would otherwise recompile each one every time it
+ * is used.  The pattern is the converted one, so it reflects the magic
+ * option and the ~ replacement, and the regcomp flags reflect the rest
+ * of the options.  The compiled RE is copied into the caller's regex_t,
+ * and must be released with re_free, which finds it by comparing those
+ * copies.
+ */
+static int
+re_cache(SCR *sp, CHAR_T *ptrn, size_t plen, int reflags, regex_t *rep)
+{
+	GS *gp;
+	RECACHE *rcp;
+	u_long size;
+	int rval;
+
+	gp = sp->gp;
+	TAILQ_FOREACH(rcp, gp->recacheq, q)
+		if (rcp->reflags == reflags && rcp->plen == plen &&
+		    !MEMCMP(rcp->ptrn, ptrn, plen)) {
+			++gp->re_hits;
+			++rcp->refcnt;
+			if (rcp != TAILQ_FIRST(gp->recacheq)) {
+				TAILQ_REMOVE(gp->recacheq, rcp, q);
+				TAILQ_INSERT_HEAD(gp->recacheq, rcp, q);
+			}
+			memcpy(rep, &rcp->re, sizeof(regex_t));
+			return (0);
+		}
+
+	++gp->re_misses;
+	if ((rval = regcomp(rep, ptrn, /* plen, */ reflags)) != 0)
+		return (rval);
+
+	/*
+	 * Make room by discarding the least recently used RE's.  If there
+	 * isn't any, because they're all in use, or we can't allocate the
+	 * memory, the RE simply isn't cached.
+	 */
+	if ((size = O_VAL(sp, O_RECACHE)) == 0)
+		return (0);
+	re_cache_trim(gp, size - 1);
+	if (gp->re_cnt >= size || (rcp = malloc(sizeof(RECACHE))) == NULL)
+		return (0);
+	if ((rcp->ptrn = malloc((plen + 1) * sizeof(CHAR_T))) == NULL) {
+		free(rcp);
+		return (0);
+	}
+	MEMCPY(rcp->ptrn, ptrn, plen);
+	rcp->plen = plen;
+	rcp->reflags = reflags;
+	memcpy(&rcp->re, rep, sizeof(regex_t));
+	rcp->refcnt = 1;
+	TAILQ_INSERT_HEAD(gp->recacheq, rcp, q);
+	++gp->re_cnt;
+	return (0);
+}
+
+/*
+ * re_cache_trim --
+ *	Discard the least recently used, unreferenced compiled RE's until
+ *	no more than size are cached.
+ *
+ * PUBLIC: void re_cache_trim(GS *, u_long);
+ */
+void
+re_cache_trim(GS *gp, u_long size)
+{
+	RECACHE *rcp, *prev;
+
+	for (rcp = TAILQ_LAST(gp->recacheq, _recacheh);
+	    rcp != NULL && gp->re_cnt > size; rcp = prev) {
+		prev = TAILQ_PREV(rcp, _recacheh, q);
+		if (rcp->refcnt != 0)
+			continue;
+		TAILQ_REMOVE(gp->recacheq, rcp, q);
+		regfree(&rcp->re);
+		free(rcp->ptrn);
+		free(rcp);
+		--gp->re_cnt;
+	}
+}
+
+/*
+ * re_free --
+ *	Release a compiled RE.
+ *
+ * PUBLIC: void re_free(SCR *, regex_t *);
+ */
+void
+re_free(SCR *sp, regex_t *rep)
+{
+	GS *gp;
+	RECACHE *rcp;
+
+	gp = sp->gp;
+	TAILQ_FOREACH(rcp, gp->recacheq, q)
+		if (!memcmp(&rcp->re, rep, sizeof(regex_t))) {
+			--rcp->refcnt;
+			re_cache_trim(gp, O_VAL(sp, O_RECACHE));
+			return;
+		}
+	regfree(rep);
+}
+
 /*
  * re_conv --
  *	Convert vi's regular expressions into something that the
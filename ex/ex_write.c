@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <sys/queue.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <bitstring.h>
 #include <ctype.h>
@@ -27,6 +28,12 @@
 
 enum which {WN, WQ, WRITE, XIT};
 static int exwr(SCR *, EXCMD *, enum which);
+static int ex_writev(SCR *,
+    int, recno_t, recno_t, recno_t *, u_long *, u_long *, int);
+static int wv_flush(int, struct iovec *, int, u_long *);
+
+#define	WRITE_NIOV	64		/* Vectored write iovecs. */
+#define	WRITE_SPANLINES	(64 * 1024)	/* Vectored write span lines. */
 
 /*
  * ex_wn --	:wn[!] [>>] [file]
@@ -281,14 +288,18 @@ int
 ex_writefp(SCR *sp, char *name, FILE *fp, MARK *fm, MARK *tm, u_long *nlno, u_long *nch, int silent)
 {
 	struct stat sb;
+	struct timespec ts, te;
+	EXF *ep;
 	GS *gp;
 	u_long ccnt;			/* XXX: can't print off_t portably. */
+	u_long wcnt;
 	recno_t fline, tline, lcnt;
 	size_t len;
 	int rval;
 	char *msg, *p;
 
 	gp = sp->gp;
+	ep = sp->ep;
 	fline = fm->lno;
 	tline = tm->lno;
 
@@ -312,10 +323,22 @@ ex_writefp(SCR *sp, char *name, FILE *fp, MARK *fm, MARK *tm, u_long *nlno, u_lo
 	 *
 	 * "Alex, I'll take vi trivia for $1000."
 	 */
+	timepoint_steady(&ts);
 	ccnt = 0;
 	lcnt = 0;
+	wcnt = 0;
 	msg = "253|Writing...";
-	if (tline != 0)
+	/*
+	 * Unless the writebuf option is 0, lines are gathered into a buffer
+	 * of that size and written to the file descriptor with writev(2),
+	 * bypassing stdio.  Runs of lines the line store holds contiguously
+	 * are written in place.  Flush anything the caller wrote first.
+	 */
+	if (tline != 0 && O_VAL(sp, O_WRITEBUF) != 0) {
+		if (fflush(fp) || ex_writev(sp, fileno(fp),
+		    fline, tline, &lcnt, &ccnt, &wcnt, silent))
+			goto err;
+	} else if (tline != 0)
 		for (; fline <= tline; ++fline, ++lcnt) {
 			/* Caller has to provide any interrupt message. */
 			if ((lcnt + 1) % INTERRUPT_CHECK == 0) {
@@ -353,7 +376,7 @@ ex_writefp(SCR *sp, char *name, FILE *fp, MARK *fm, MARK *tm, u_long *nlno, u_lo
 
 	rval = 0;
 	if (0) {
-err:		if (!F_ISSET(sp->ep, F_MULTILOCK))
+err:		if (!F_ISSET(ep, F_MULTILOCK))
 			msgq_str(sp, M_SYSERR, name, "%s");
 		(void)fclose(fp);
 		rval = 1;
@@ -362,6 +385,16 @@ err:		if (!F_ISSET(sp->ep, F_MULTILOCK))
 	if (!silent)
 		gp->scr_busy(sp, NULL, BUSY_OFF);
 
+	/* Save the write statistics, see ex_display.c:wdisplay(). */
+	if (!F_ISSET(ep, F_MULTILOCK)) {
+		timepoint_steady(&te);
+		timespecsub(&te, &ts);
+		ep->w_lines = lcnt;
+		ep->w_bytes = ccnt;
+		ep->w_calls = wcnt;
+		ep->w_time = te;
+	}
+
 	/* Report the possibly partial transfer. */
 	if (nlno != NULL) {
 		*nch = ccnt;
@@ -369,3 +402,126 @@ err:		if (!F_ISSET(sp->ep, F_MULTILOCK))
 	}
 	return (rval);
 }
+
+/*
+ * ex_writev --
+ *	Write a range of lines to a file descriptor, O_WRITEBUF bytes at a
+ *	time.
+ */
+static int
+ex_writev(SCR *sp, int fd, recno_t fline, recno_t tline,
+    recno_t *lcntp, u_long *ccntp, u_long *wcntp, int silent)
+{
+	static char nl = '\n';
+	struct iovec iov[WRITE_NIOV];
+	GS *gp;
+	recno_t n;
+	size_t blen, bsize, bstart, len, pend;
+	int force, niov, rval;
+	char *bp, *msg, *p;
+
+	gp = sp->gp;
+	bsize = O_VAL(sp, O_WRITEBUF);
+	if ((bp = malloc(bsize)) == NULL)
+		return (1);
+
+	/*
+	 * The buffer is filled from its start, bstart is the start of the
+	 * part of it that isn't yet in the iovec array.  Lines are added to
+	 * the array in place if the line store returns them a run at a time,
+	 * or if they don't fit into the buffer, in which case, since lines
+	 * returned by db_rget() are only valid until the next call, they're
+	 * written immediately.
+	 */
+#define	WV_SEGMENT {							\
+	if (blen > bstart) {						\
+		iov[niov].iov_base = bp + bstart;			\
+		iov[niov++].iov_len = blen - bstart;			\
+		bstart = blen;						\
+	}								\
+}
+	blen = bstart = pend = 0;
+	force = niov = 0;
+	msg = "253|Writing...";
+	for (; fline <= tline; fline += n) {
+		if (db_rspan(sp, fline,
+		    MIN(tline - fline + 1, WRITE_SPANLINES), &p, &len, &n))
+			goto err;
+		if (n != 0) {
+			WV_SEGMENT;
+			iov[niov].iov_base = p;
+			iov[niov++].iov_len = len;
+		} else {
+			if (db_rget(sp, fline, &p, &len))
+				goto err;
+			n = 1;
+			if (len < bsize - blen) {
+				memcpy(bp + blen, p, len);
+				blen += len;
+				bp[blen++] = '\n';
+			} else {
+				WV_SEGMENT;
+				iov[niov].iov_base = p;
+				iov[niov++].iov_len = len;
+				iov[niov].iov_base = &nl;
+				iov[niov++].iov_len = 1;
+				force = 1;
+			}
+			++len;
+		}
+		pend += len;
+		*ccntp += len;
+		*lcntp += n;
+
+		if (!force && pend < bsize && niov < WRITE_NIOV - 2)
+			continue;
+		WV_SEGMENT;
+		if (wv_flush(fd, iov, niov, wcntp))
+			goto err;
+		blen = bstart = pend = 0;
+		force = niov = 0;
+
+		/* Caller has to provide any interrupt message. */
+		if (fline + n <= tline) {
+			if (INTERRUPTED(sp))
+				break;
+			if (!silent) {
+				gp->scr_busy(sp, msg,
+				    msg == NULL ? BUSY_UPDATE : BUSY_ON);
+				msg = NULL;
+			}
+		}
+	}
+	WV_SEGMENT;
+	rval = wv_flush(fd, iov, niov, wcntp);
+	if (0)
+err:		rval = 1;
+	free(bp);
+	return (rval);
+}
+
+/*
+ * wv_flush --
+ *	Write an iovec array, restarting partial and interrupted writes.
+ */
+static int
+wv_flush(int fd, struct iovec *iov, int niov, u_long *wcntp)
+{
+	ssize_t nw;
+
+	while (niov > 0) {
+		++*wcntp;
+		if ((nw = writev(fd, iov, niov)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return (1);
+		}
+		for (; niov > 0 && (size_t)nw >= iov->iov_len; ++iov, --niov)
+			nw -= iov->iov_len;
+		if (niov > 0) {
+			iov->iov_base = (char *)iov->iov_base + nw;
+			iov->iov_len -= nw;
+		}
+	}
+	return (0);
+}
@@ -48,10 +48,47 @@
 #define	slow	sslow
 #define	dissect	sdissect
 #define	backref	sbackref
+#define	backtry	sbacktry
+#define	split	ssplit
+#define	boundary	sboundary
+#define	tstep	ststep
 #define	step	sstep
 #define	print	sprint
 #define	at	sat
 #define	match	smat
+#define	dfainit	sdfainit
+#define	dfaflush	sdfaflush
+#define	dfasplit	sdfasplit
+#define	dfacat	sdfacat
+#define	dfastate	sdfastate
+#define	dfapre	sdfapre
+#define	dfastep	sdfastep
+#define	dfarun	sdfarun
+#define	backward	sbackward
+#endif
+#ifdef MNAMES
+#define	matcher	mmatcher
+#define	fast	mfast
+#define	slow	mslow
+#define	dissect	mdissect
+#define	backref	mbackref
+#define	backtry	mbacktry
+#define	split	msplit
+#define	boundary	mboundary
+#define	tstep	mtstep
+#define	step	mstep
+#define	print	mprint
+#define	at	mat
+#define	match	mmat
+#define	dfainit	mdfainit
+#define	dfaflush	mdfaflush
+#define	dfasplit	mdfasplit
+#define	dfacat	mdfacat
+#define	dfastate	mdfastate
+#define	dfapre	mdfapre
+#define	dfastep	mdfastep
+#define	dfarun	mdfarun
+#define	backward	mbackward
 #endif
 #ifdef LNAMES
 #define	matcher	lmatcher
@@ -59,10 +96,23 @@
 #define	slow	lslow
 #define	dissect	ldissect
 #define	backref	lbackref
+#define	backtry	lbacktry
+#define	split	lsplit
+#define	boundary	lboundary
+#define	tstep	ltstep
 #define	step	lstep
 #define	print	lprint
 #define	at	lat
 #define	match	lmat
+#define	dfainit	ldfainit
+#define	dfaflush	ldfaflush
+#define	dfasplit	ldfasplit
+#define	dfacat	ldfacat
+#define	dfastate	ldfastate
+#define	dfapre	ldfapre
+#define	dfastep	ldfastep
+#define	dfarun	ldfarun
+#define	backward	lbackward
 #endif
 
 /* another structure passed up and down to avoid zillions of parameters */
@@ -74,7 +124,15 @@ struct match {
 	const RCHAR_T *beginp;		/* start of string -- virtual NUL precedes */
 	const RCHAR_T *endp;		/* end of string -- virtual NUL here */
 	const RCHAR_T *coldp;		/* can be no match starting before here */
+	const RCHAR_T *minendp;	/* fast() ignores matches ending before here */
 	const RCHAR_T **lastpos;	/* [nplus+1] */
+	const RCHAR_T **tags;	/* [2*nstates] for split() */
+	uch *ends;		/* [endp-coldp+1] for split() */
+	unsigned long nsteps;	/* calls to backref() */
+	regoff_t *memo;		/* [BR_NMEMO] backref() failures */
+	int memohead[BR_NHASH];	/* memo hash chains */
+	size_t nmemo;		/* memo entries used */
+	int nomemo;		/* memo is full or couldn't be allocated */
 	STATEVARS;
 	states st;		/* current states */
 	states fresh;		/* states for a fresh start */
@@ -90,10 +148,23 @@ extern "C" {
 /* === engine.c === */
 static int matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch, regmatch_t pmatch[], int eflags);
 static const RCHAR_T *dissect(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst, sopno stopst);
+static const RCHAR_T *split(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst, sopno midst, sopno stopst);
 static const RCHAR_T *backref(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst, sopno stopst, sopno lev);
+static const RCHAR_T *backtry(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst, sopno stopst, sopno lev);
 static const RCHAR_T *fast(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst, sopno stopst);
 static const RCHAR_T *slow(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst, sopno stopst);
+static struct re_dfa *dfainit(struct match *m);
+static void dfaflush(struct re_dfa *dfa);
+static void dfasplit(struct re_dfa *dfa, const uch *in);
+static int dfacat(struct match *m, RCHAR_T c);
+static struct re_dstate *dfastate(struct match *m, int mode, int cat, const uch *set);
+static states dfapre(struct match *m, struct re_dstate *ds, RCHAR_T c, states st);
+static struct re_dstate *dfastep(struct match *m, struct re_dstate *ds, RCHAR_T c, int *accp);
+static int dfarun(struct match *m, int mode, const RCHAR_T *start, const RCHAR_T *stop, const RCHAR_T **endp);
+static int backward(struct match *om, const RCHAR_T *limit, const RCHAR_T **startp);
 static states step(struct re_guts *g, sopno start, sopno stop, states bef, int flag, RCHAR_T ch, states aft);
+static int boundary(struct match *m, RCHAR_T lastc, RCHAR_T c, int *np, int *wp);
+static void tstep(struct re_guts *g, sopno start, sopno stop, const RCHAR_T **bef, int flag, RCHAR_T ch, const RCHAR_T **aft);
 #define	BOL	(1)
 #define	EOL	(BOL+1)
 #define	BOLEOL	(BOL+2)
@@ -141,6 +212,9 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 	const sopno gl = g->laststate;
 	const RCHAR_T *start;
 	const RCHAR_T *stop;
+	const RCHAR_T *limit;	/* REG_BACKWARD: last place a match can start */
+	int found;		/* REG_BACKWARD: pmatch[] has a match in it */
+	int rv;
 
 	/* simplify the situation where possible */
 	if (g->cflags&REG_NOSUB)
@@ -155,13 +229,22 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 	if (stop < start)
 		return(REG_INVARG);
 
+	/*
+	 * With REG_BACKWARD, the string runs from its beginning, and the
+	 * match wanted is the one that starts last, no later than the end
+	 * of the string or, with REG_STARTEND, its start.
+	 */
+	limit = NULL;
+	if (eflags&REG_BACKWARD) {
+		limit = (eflags&REG_STARTEND) ? start : stop;
+		start = string;
+	}
+
 	/* prescreening; this does wonders for this rather slow code */
+	dp = NULL;
 	if (g->must != NULL) {
-		for (dp = start; dp < stop; dp++)
-			if (*dp == g->must[0] && (size_t)(stop - dp) >= g->mlen &&
-				MEMCMP(dp, g->must, g->mlen) == 0)
-				break;
-		if (dp == stop)		/* we didn't find g->must */
+		dp = mustscan(g, start, stop);
+		if (dp == NULL)		/* we didn't find g->must */
 			return(REG_NOMATCH);
 	}
 
@@ -170,9 +253,20 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 	m->eflags = eflags;
 	m->pmatch = NULL;
 	m->lastpos = NULL;
+	m->tags = NULL;
+	m->ends = NULL;
+	m->nsteps = 0;
+	m->memo = NULL;
+	m->nmemo = 0;
+	m->nomemo = 0;
 	m->offp = string;
 	m->beginp = start;
 	m->endp = stop;
+	m->minendp = start;
+
+	/* no match starts before the first place a prefix of them does */
+	if (dp != NULL && g->mprefix)
+		start = dp;
 	STATESETUP(m, 4);
 	SETUP(m->st);
 	SETUP(m->fresh);
@@ -180,12 +274,23 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 	SETUP(m->empty);
 	CLEAR(m->empty);
 
+	/* the reversed expression finds where the match starts */
+	if (limit != NULL && g->rev != NULL) {
+		rv = backward(m, limit, &start);
+		if (rv != 0) {
+			STATETEARDOWN(m);
+			return(rv);
+		}
+	}
+	found = 0;
+
+again:
 	/* this loop does only one repetition except for backrefs */
 	for (;;) {
 		endp = fast(m, start, stop, gf, gl);
 		if (endp == NULL) {		/* a miss */
-			STATETEARDOWN(m);
-			return(REG_NOMATCH);
+			rv = found ? 0 : REG_NOMATCH;
+			goto done;
 		}
 		if (nmatch == 0 && !g->backrefs)
 			break;		/* no further info needed */
@@ -208,12 +313,19 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 			m->pmatch = (regmatch_t *)malloc((m->g->nsub + 1) *
 							sizeof(regmatch_t));
 		if (m->pmatch == NULL) {
-			STATETEARDOWN(m);
-			return(REG_ESPACE);
+			rv = REG_ESPACE;
+			goto done;
 		}
 		for (i = 1; i <= m->g->nsub; i++)
 			m->pmatch[i].rm_so = m->pmatch[i].rm_eo = -1;
 		if (!g->backrefs && !(m->eflags&REG_BACKR)) {
+			m->tags = (const RCHAR_T **)malloc(2 * g->nstates *
+							sizeof(const RCHAR_T *));
+			m->ends = (uch *)malloc(endp - m->coldp + 1);
+			if (m->tags == NULL || m->ends == NULL) {
+				rv = REG_ESPACE;
+				goto done;
+			}
 			NOTE("dissecting");
 			dp = dissect(m, m->coldp, endp, gf, gl);
 		} else {
@@ -221,14 +333,13 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 				m->lastpos = (const RCHAR_T **)malloc((g->nplus+1) *
 							sizeof(const RCHAR_T *));
 			if (g->nplus > 0 && m->lastpos == NULL) {
-				free(m->pmatch);
-				STATETEARDOWN(m);
-				return(REG_ESPACE);
+				rv = REG_ESPACE;
+				goto done;
 			}
 			NOTE("backref dissect");
 			dp = backref(m, m->coldp, endp, gf, gl, (sopno)0);
 		}
-		if (dp != NULL)
+		if (dp != NULL || m->nsteps > BR_MAXSTEPS)
 			break;
 
 		/* uh-oh... we couldn't find a subexpression-level match */
@@ -250,10 +361,14 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 #endif
 			NOTE("backoff dissect");
 			dp = backref(m, m->coldp, endp, gf, gl, (sopno)0);
+			if (m->nsteps > BR_MAXSTEPS)
+				break;
 		}
 		assert(dp == NULL || dp == endp);
 		if (dp != NULL)		/* found a shorter one */
 			break;
+		if (m->nsteps > BR_MAXSTEPS)
+			break;		/* gave up */
 
 		/* despite initial appearances, there is no match here */
 		NOTE("false alarm");
@@ -261,6 +376,20 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 		assert(start <= stop);
 	}
 
+	if (m->nsteps > BR_MAXSTEPS) {
+		rv = REG_ESTEPS;
+		goto done;
+	}
+
+	/*
+	 * Back references can't be run backwards, so with them, REG_BACKWARD
+	 * finds one match after another, until the next one starts too late.
+	 */
+	if (limit != NULL && g->rev == NULL && m->coldp > limit) {
+		rv = found ? 0 : REG_NOMATCH;
+		goto done;
+	}
+
 	/* fill in the details if requested */
 	if (nmatch > 0) {
 		pmatch[0].rm_so = m->coldp - m->offp;
@@ -276,13 +405,89 @@ matcher(struct re_guts *g, const RCHAR_T *string, size_t nmatch,
 				pmatch[i].rm_eo = -1;
 			}
 	}
+	if (limit != NULL && g->rev == NULL && m->coldp < limit) {
+		found = 1;
+		start = m->coldp + 1;
+		m->nsteps = 0;		/* each match gets its own budget */
+		goto again;
+	}
+	rv = 0;
 
+done:
 	if (m->pmatch != NULL)
 		free((char *)m->pmatch);
 	if (m->lastpos != NULL)
 		free((char *)m->lastpos);
+	if (m->tags != NULL)
+		free((char *)m->tags);
+	if (m->ends != NULL)
+		free(m->ends);
+	if (m->memo != NULL)
+		free(m->memo);
 	STATETEARDOWN(m);
-	return(0);
+	return(rv);
+}
+
+/*
+ - backward - find where the match that starts last starts
+ *
+ * The reversed expression (see revguts() in regexec.c) is run forward over
+ * the reversed string, from the end of the string.  A match of it that
+ * ends somewhere is a match of the expression that starts there, so the
+ * first one that ends at or after the limit is the one we want.  The
+ * string is only reversed in a buffer of its own, to keep the matchers
+ * simple; the rest of the match is then found forward from where it starts.
+ */
+static int			/* 0, REG_NOMATCH or REG_ESPACE */
+backward(struct match *om, const RCHAR_T *limit, const RCHAR_T **startp)
+{
+	struct match mv;
+	struct match *m = &mv;
+	RCHAR_T *rbuf;
+	const RCHAR_T *endp;
+	size_t i, len;
+
+	m->g = om->g->rev;
+	m->eflags = om->eflags & ~(REG_NOTBOL|REG_NOTEOL);
+	if (om->eflags&REG_NOTBOL)
+		m->eflags |= REG_NOTEOL;
+	if (om->eflags&REG_NOTEOL)
+		m->eflags |= REG_NOTBOL;
+	m->pmatch = NULL;
+	m->lastpos = NULL;
+	m->tags = NULL;
+	m->ends = NULL;
+	m->nsteps = 0;
+	m->memo = NULL;
+	m->nmemo = 0;
+	m->nomemo = 0;
+	STATESETUP(m, 4);
+	SETUP(m->st);
+	SETUP(m->fresh);
+	SETUP(m->tmp);
+	SETUP(m->empty);
+	CLEAR(m->empty);
+
+	len = om->endp - om->beginp;
+	rbuf = (RCHAR_T *)malloc((len + 1) * sizeof(RCHAR_T));
+	if (rbuf == NULL) {
+		STATETEARDOWN(m);
+		return(REG_ESPACE);
+	}
+	for (i = 0; i < len; i++)
+		rbuf[i] = om->beginp[len - 1 - i];
+	m->offp = rbuf;
+	m->beginp = rbuf;
+	m->endp = rbuf + len;
+	m->minendp = rbuf + (om->endp - limit);
+
+	NOTE("backward");
+	endp = fast(m, rbuf, m->endp, m->g->firststate+1, m->g->laststate);
+	if (endp != NULL)
+		*startp = om->endp - ((endp - 1) - rbuf);
+	STATETEARDOWN(m);
+	free(rbuf);
+	return((endp != NULL) ? 0 : REG_NOMATCH);
 }
 
 /*
@@ -296,9 +501,7 @@ dissect(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
 	sopno ss;	/* start sop of current subRE */
 	sopno es;	/* end sop of current subRE */
 	const RCHAR_T *sp;	/* start of string matched by it */
-	const RCHAR_T *stp;	/* string matched by it cannot pass here */
 	const RCHAR_T *rest;	/* start of rest of string */
-	const RCHAR_T *tail;	/* string unmatched by rest of RE */
 	sopno ssub;	/* start sop of subsubRE */
 	sopno esub;	/* end sop of subsubRE */
 	const RCHAR_T *ssp;	/* start of string matched by subsubRE */
@@ -346,19 +549,9 @@ dissect(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
 			break;
 		/* cases where length of match is hard to find */
 		case OQUEST_:
-			stp = stop;
-			for (;;) {
-				/* how long could this one be? */
-				rest = slow(m, sp, stp, ss, es);
-				assert(rest != NULL);	/* it did match */
-				/* could the rest match the rest? */
-				tail = slow(m, rest, stop, es, stopst);
-				if (tail == stop)
-					break;		/* yes! */
-				/* no -- try a shorter match for this one */
-				stp = rest - 1;
-				assert(stp >= sp);	/* it did work */
-			}
+			/* how long could this one be, with the rest matching? */
+			rest = split(m, sp, stop, ss, es, stopst);
+			assert(rest != NULL);	/* it did match */
 			ssub = ss + 1;
 			esub = es - 1;
 			/* did innards match? */
@@ -370,19 +563,9 @@ dissect(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
 			sp = rest;
 			break;
 		case OPLUS_:
-			stp = stop;
-			for (;;) {
-				/* how long could this one be? */
-				rest = slow(m, sp, stp, ss, es);
-				assert(rest != NULL);	/* it did match */
-				/* could the rest match the rest? */
-				tail = slow(m, rest, stop, es, stopst);
-				if (tail == stop)
-					break;		/* yes! */
-				/* no -- try a shorter match for this one */
-				stp = rest - 1;
-				assert(stp >= sp);	/* it did work */
-			}
+			/* how long could this one be, with the rest matching? */
+			rest = split(m, sp, stop, ss, es, stopst);
+			assert(rest != NULL);	/* it did match */
 			ssub = ss + 1;
 			esub = es - 1;
 			ssp = sp;
@@ -406,19 +589,9 @@ dissect(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
 			sp = rest;
 			break;
 		case OCH_:
-			stp = stop;
-			for (;;) {
-				/* how long could this one be? */
-				rest = slow(m, sp, stp, ss, es);
-				assert(rest != NULL);	/* it did match */
-				/* could the rest match the rest? */
-				tail = slow(m, rest, stop, es, stopst);
-				if (tail == stop)
-					break;		/* yes! */
-				/* no -- try a shorter match for this one */
-				stp = rest - 1;
-				assert(stp >= sp);	/* it did work */
-			}
+			/* how long could this one be, with the rest matching? */
+			rest = split(m, sp, stop, ss, es, stopst);
+			assert(rest != NULL);	/* it did match */
 			ssub = ss + 1;
 			esub = ss + m->g->stripdata[ss] - 1;
 			assert(m->g->strip[esub] == OOR1);
@@ -467,12 +640,198 @@ dissect(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
 	return(sp);
 }
 
+/*
+ - split - find where a subRE ends, given that the rest of the RE matches
+ *
+ * dissect() wants the longest match of the subRE from startst to midst,
+ * starting at start, that leaves the rest of the RE, up to stopst, matching
+ * the rest of the string exactly.  Trying ever shorter matches with slow()
+ * takes time quadratic in the length of the string, so instead one pass
+ * marks everywhere the subRE can end, and a second runs the rest of the
+ * RE from all of those places at once, each of its states tagged with
+ * the latest place a path to it started from.  Two paths that reach the
+ * same state have the same future, so only the latest need be kept.
+ */
+static const RCHAR_T *			/* where the subRE ends, or NULL */
+split(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
+    sopno startst, sopno midst, sopno stopst)
+{
+	struct re_guts *g = m->g;
+	states st = m->st;
+	states empty = m->empty;
+	states tmp = m->tmp;
+	const RCHAR_T **cur = m->tags;
+	const RCHAR_T **nxt = m->tags + g->nstates;
+	const RCHAR_T **t;
+	uch *ends = m->ends;
+	const RCHAR_T *p;
+	const RCHAR_T *first;	/* first place the subRE ends */
+	RCHAR_T c;
+	RCHAR_T lastc;	/* previous c */
+	int flag;
+	int wflag;
+	int i;
+	sopno pc;
+
+	AT("split", start, stop, startst, stopst);
+
+	/* where can the subRE end?  this is slow(), remembering them all */
+	memset(ends, 0, stop - start + 1);
+	first = NULL;
+	p = start;
+	c = (start == m->beginp) ? OUT : *(start-1);
+	CLEAR(st);
+	SET1(st, startst);
+	st = step(g, startst, midst, st, NOTHING, OUT, st);
+	for (;;) {
+		lastc = c;
+		c = (p == m->endp) ? OUT : *p;
+		flag = boundary(m, lastc, c, &i, &wflag);
+		for (; i > 0; i--)
+			st = step(g, startst, midst, st, flag, OUT, st);
+		if (wflag != 0)
+			st = step(g, startst, midst, st, wflag, OUT, st);
+		if (ISSET(st, midst)) {
+			ends[p - start] = 1;
+			if (first == NULL)
+				first = p;
+		}
+		if (EQ(st, empty) || p == stop)
+			break;
+		ASSIGN(tmp, st);
+		ASSIGN(st, empty);
+		st = step(g, startst, midst, tmp, 0, FOLD(g, c), st);
+		p++;
+	}
+	if (first == NULL)
+		return(NULL);
+
+	/* which is the last one the rest of the RE matches from? */
+	for (pc = midst; pc <= stopst; pc++)
+		cur[pc] = NULL;
+	p = first;
+	c = (p == m->beginp) ? OUT : *(p-1);
+	for (;;) {
+		lastc = c;
+		c = (p == m->endp) ? OUT : *p;
+		if (ends[p - start]) {
+			cur[midst] = p;
+			tstep(g, midst, stopst, cur, NOTHING, OUT, cur);
+		}
+		flag = boundary(m, lastc, c, &i, &wflag);
+		for (; i > 0; i--)
+			tstep(g, midst, stopst, cur, flag, OUT, cur);
+		if (wflag != 0)
+			tstep(g, midst, stopst, cur, wflag, OUT, cur);
+		if (p == stop)
+			break;
+		for (pc = midst; pc <= stopst; pc++)
+			nxt[pc] = NULL;
+		tstep(g, midst, stopst, cur, 0, FOLD(g, c), nxt);
+		t = cur;
+		cur = nxt;
+		nxt = t;
+		p++;
+	}
+	return(cur[stopst]);
+}
+
 /*
  - backref - figure out what matched what, figuring in back references
+ *
+ * backtry() is a backtracking search, and can take exponential time.  So
+ * the search gives up after BR_MAXSTEPS calls, and after BR_MEMOSTEPS, it
+ * starts remembering where it failed from, so as not to search from there
+ * again.  Where it is is the arguments plus everything else the search
+ * depends on: the subexpression offsets, and the start of the current
+ * pass through each enclosing +.  A failed search can change the latter,
+ * so the changes are remembered, too, and repeated.
  */
 static const RCHAR_T *			/* == stop (success) or NULL (failure) */
 backref(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
     sopno startst, sopno stopst, sopno lev) /* PLUS nesting level */
+{
+	struct re_guts *g = m->g;
+	const RCHAR_T *dp;
+	regoff_t *e, *f, *key;
+	size_t i, n, klen, w;
+	unsigned int h;
+	int j;
+
+	if (++m->nsteps > BR_MAXSTEPS)
+		return(NULL);		/* give up */
+	if (m->nsteps < BR_MEMOSTEPS || m->nomemo)
+		return(backtry(m, start, stop, startst, stopst, lev));
+
+	/*
+	 * An entry is the next entry in the hash chain, the hash, the key,
+	 * and the + starts the search left behind when it failed.
+	 */
+	klen = 5 + 2*g->nsub + g->nplus;
+	w = 2 + klen + g->nplus;
+	if (m->memo == NULL) {
+		m->memo = (regoff_t *)malloc(BR_NMEMO * w * sizeof(regoff_t));
+		if (m->memo == NULL) {
+			m->nomemo = 1;
+			return(backtry(m, start, stop, startst, stopst, lev));
+		}
+		for (j = 0; j < BR_NHASH; j++)
+			m->memohead[j] = -1;
+	}
+	if (m->nmemo == BR_NMEMO) {	/* full */
+		m->nomemo = 1;
+		return(backtry(m, start, stop, startst, stopst, lev));
+	}
+
+	e = m->memo + m->nmemo * w;
+	key = e + 2;
+	key[0] = startst;
+	key[1] = stopst;
+	key[2] = lev;
+	key[3] = start - m->offp;
+	key[4] = stop - m->offp;
+	n = 5;
+	for (i = 1; i <= g->nsub; i++) {
+		key[n++] = m->pmatch[i].rm_so;
+		key[n++] = m->pmatch[i].rm_eo;
+	}
+	for (i = 1; i <= g->nplus; i++)
+		key[n++] = (i <= lev) ? m->lastpos[i] - m->offp : -1;
+	h = 2166136261U;	/* FNV-1a */
+	for (i = 0; i < klen; i++)
+		h = (h ^ (unsigned int)key[i]) * 16777619U;
+
+	for (j = m->memohead[h & (BR_NHASH-1)]; j != -1; j = (int)f[0]) {
+		f = m->memo + j * w;
+		if ((unsigned int)f[1] == h &&
+		    memcmp(f + 2, key, klen * sizeof(regoff_t)) == 0) {
+			for (i = 1; i <= lev; i++)
+				m->lastpos[i] = m->offp + f[2 + klen + i - 1];
+			return(NULL);
+		}
+	}
+
+	j = m->nmemo++;
+	dp = backtry(m, start, stop, startst, stopst, lev);
+	if (dp != NULL) {
+		if ((size_t)j == m->nmemo - 1)
+			m->nmemo--;
+		return(dp);
+	}
+	for (i = 1; i <= lev; i++)
+		e[2 + klen + i - 1] = m->lastpos[i] - m->offp;
+	e[1] = h;
+	e[0] = m->memohead[h & (BR_NHASH-1)];
+	m->memohead[h & (BR_NHASH-1)] = j;
+	return(NULL);
+}
+
+/*
+ - backtry - backref() the hard way
+ */
+static const RCHAR_T *			/* == stop (success) or NULL (failure) */
+backtry(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
+    sopno startst, sopno stopst, sopno lev) /* PLUS nesting level */
 {
 	int i;
 	sopno ss;	/* start sop of current subRE */
@@ -498,8 +857,9 @@ backref(struct match *m, const RCHAR_T *start, const RCHAR_T *stop,
 		d = m->g->stripdata[ss];
 		switch (s) {
 		case OCHAR:
-			if (sp == stop || *sp++ != d)
+			if (sp == stop || FOLD(m->g, *sp) != d)
 				return(NULL);
+			sp++;
 			break;
 		case OANY:
 			if (sp == stop)
@@ -689,6 +1049,12 @@ fast(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst,
 	int flag;
 	int i;
 	const RCHAR_T *coldp;	/* last p after which no match was underway */
+	const RCHAR_T *dp;
+
+	if (startst == m->g->firststate+1 && stopst == m->g->laststate &&
+	    !m->g->backrefs && dfainit(m) != NULL &&
+	    dfarun(m, DFA_FAST, start, stop, &dp) == 0)
+		return(dp);
 
 	CLEAR(st);
 	SET1(st, startst);
@@ -737,14 +1103,14 @@ fast(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst,
 		}
 
 		/* are we done? */
-		if (ISSET(st, stopst) || p == stop)
+		if ((ISSET(st, stopst) && p >= m->minendp) || p == stop)
 			break;		/* NOTE BREAK OUT */
 
 		/* no, we must deal with this character */
 		ASSIGN(tmp, st);
 		ASSIGN(st, fresh);
 		assert(c != OUT);
-		st = step(m->g, startst, stopst, tmp, 0, c, st);
+		st = step(m->g, startst, stopst, tmp, 0, FOLD(m->g, c), st);
 		SP("aft", st, c);
 		assert(EQ(step(m->g, startst, stopst, st, NOTHING, OUT, st), st));
 		p++;
@@ -752,7 +1118,7 @@ fast(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst,
 
 	assert(coldp != NULL);
 	m->coldp = coldp;
-	if (ISSET(st, stopst))
+	if (ISSET(st, stopst) && p >= m->minendp)
 		return(p+1);
 	else
 		return(NULL);
@@ -776,6 +1142,11 @@ slow(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst,
 	const RCHAR_T *matchp;	/* last p at which a match ended */
 
 	AT("slow", start, stop, startst, stopst);
+	if (startst == m->g->firststate+1 && stopst == m->g->laststate &&
+	    !m->g->backrefs && dfainit(m) != NULL &&
+	    dfarun(m, DFA_SLOW, start, stop, &matchp) == 0)
+		return(matchp);
+
 	CLEAR(st);
 	SET1(st, startst);
 	SP("sstart", st, *p);
@@ -829,7 +1200,7 @@ slow(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst,
 		ASSIGN(tmp, st);
 		ASSIGN(st, empty);
 		assert(c != OUT);
-		st = step(m->g, startst, stopst, tmp, 0, c, st);
+		st = step(m->g, startst, stopst, tmp, 0, FOLD(m->g, c), st);
 		SP("saft", st, c);
 		assert(EQ(step(m->g, startst, stopst, st, NOTHING, OUT, st), st));
 		p++;
@@ -838,6 +1209,336 @@ slow(struct match *m, const RCHAR_T *start, const RCHAR_T *stop, sopno startst,
 	return(matchp);
 }
 
+/*
+ - dfainit - set up the DFA, if it isn't already
+ *
+ * The DFA simulates fast() and slow() run over the whole expression, and
+ * is built a state at a time by dfastep() as the strings being matched
+ * need it.  It's only used if there are no back references, which the
+ * NFA can't get right without backref() anyway.
+ */
+static struct re_dfa *		/* NULL if no memory */
+dfainit(struct match *m)
+{
+	struct re_guts *g = m->g;
+	struct re_dfa *dfa;
+	states st = m->st;
+	const sopno gf = g->firststate+1;
+	const sopno gl = g->laststate;
+	uch in[NC];
+	sopno pc;
+	size_t i;
+	int b;
+
+	dfa = g->dfa;
+	if (dfa != NULL) {
+		if (dfa->rep == STATEREP)
+			return(dfa);
+		/* matched with another representation last time */
+		dfaflush(dfa);
+		free(dfa);
+		g->dfa = NULL;
+	}
+
+	dfa = (struct re_dfa *)malloc(sizeof(struct re_dfa) + STATESIZE);
+	if (dfa == NULL)
+		return(NULL);
+	dfa->rep = STATEREP;
+	dfa->setlen = STATESIZE;
+	dfa->fresh = (uch *)(dfa + 1);
+	dfa->mem = 0;
+	dfa->gen = 0;
+	for (i = 0; i < DFA_NHASH; i++)
+		dfa->hash[i] = NULL;
+	dfaflush(dfa);
+
+	/*
+	 * Characters are in the same class unless the expression can tell
+	 * them apart, i.e., unless one of them is a word character, or a
+	 * newline that ends lines, or a literal (once folded, with
+	 * REG_ICASE), or in a bracket expression that the other isn't.
+	 */
+	dfa->nclass = 1;
+	memset(dfa->cmap, 0, sizeof(dfa->cmap));
+	for (b = 0; b < NC; b++)
+		in[b] = ISWORD((RCHAR_T)b) != 0;
+	dfasplit(dfa, in);
+	if (g->cflags&REG_NEWLINE) {
+		for (b = 0; b < NC; b++)
+			in[b] = b == '\n';
+		dfasplit(dfa, in);
+	}
+	for (pc = gf; pc < gl; pc++)
+		if (g->strip[pc] == OCHAR) {
+			for (b = 0; b < NC; b++)
+				in[b] = FOLD(g, (RCHAR_T)b) == g->stripdata[pc];
+			dfasplit(dfa, in);
+		}
+	for (i = 0; i < g->ncsets; i++) {
+		for (b = 0; b < NC; b++)
+			in[b] = CHIN(&g->sets[i], b) != 0;
+		dfasplit(dfa, in);
+	}
+
+	CLEAR(st);
+	SET1(st, gf);
+	st = step(g, gf, gl, st, NOTHING, OUT, st);
+	memcpy(dfa->fresh, STATEBYTES(st), STATESIZE);
+
+	g->dfa = dfa;
+	return(dfa);
+}
+
+/*
+ - dfaflush - throw away the DFA's states
+ */
+static void
+dfaflush(struct re_dfa *dfa)
+{
+	struct re_dstate *ds, *nds;
+	int i, j;
+
+	for (i = 0; i < DFA_NHASH; i++) {
+		for (ds = dfa->hash[i]; ds != NULL; ds = nds) {
+			nds = ds->hnext;
+			free(ds);
+		}
+		dfa->hash[i] = NULL;
+	}
+	for (i = 0; i < 2; i++)
+		for (j = 0; j < DC_NCAT; j++)
+			dfa->start[i][j] = NULL;
+	dfa->mem = 0;
+	dfa->gen++;
+}
+
+/*
+ - dfasplit - split character classes on membership in a set of bytes
+ */
+static void
+dfasplit(struct re_dfa *dfa, const uch *in)
+{
+	int map[2*NC];
+	int b, n;
+
+	for (b = 0; b < 2*dfa->nclass; b++)
+		map[b] = -1;
+	n = 0;
+	for (b = 0; b < NC; b++) {
+		if (map[2*dfa->cmap[b] + in[b]] == -1)
+			map[2*dfa->cmap[b] + in[b]] = n++;
+		dfa->cmap[b] = map[2*dfa->cmap[b] + in[b]];
+	}
+	dfa->nclass = n;
+}
+
+/*
+ - dfacat - category of a character preceding a DFA state
+ */
+static int
+dfacat(struct match *m, RCHAR_T c)	/* OUT for the start of the string */
+{
+	if (c == OUT)
+		return((m->eflags&REG_NOTBOL) ? DC_NOBOL : DC_BOL);
+	if (c == '\n' && m->g->cflags&REG_NEWLINE)
+		return(DC_NL);
+	return(ISWORD(c) ? DC_WORD : DC_OTHER);
+}
+
+/*
+ - dfastate - find or add a DFA state
+ */
+static struct re_dstate *	/* NULL if no memory */
+dfastate(struct match *m, int mode, int cat, const uch *set)
+{
+	struct re_dfa *dfa = m->g->dfa;
+	struct re_dstate *ds;
+	unsigned int h;
+	size_t i, len;
+	int j;
+
+	h = 2166136261U ^ (unsigned int)(mode << 8 | cat);	/* FNV-1a */
+	for (i = 0; i < dfa->setlen; i++)
+		h = (h ^ set[i]) * 16777619U;
+	for (ds = dfa->hash[h & (DFA_NHASH-1)]; ds != NULL; ds = ds->hnext)
+		if (ds->hash == h && ds->mode == mode && ds->cat == cat &&
+		    memcmp(ds->set, set, dfa->setlen) == 0)
+			return(ds);
+
+	len = sizeof(struct re_dstate) +
+	    dfa->nclass * (sizeof(struct re_dstate *) + 1) + dfa->setlen;
+	if (dfa->mem + len > DFA_MAXMEM)
+		dfaflush(dfa);
+	ds = (struct re_dstate *)malloc(len);
+	if (ds == NULL)
+		return(NULL);
+	ds->next = (struct re_dstate **)(ds + 1);
+	ds->acc = (uch *)(ds->next + dfa->nclass);
+	ds->set = ds->acc + dfa->nclass;
+	for (j = 0; j < dfa->nclass; j++)
+		ds->next[j] = NULL;
+	memcpy(ds->set, set, dfa->setlen);
+	ds->hash = h;
+	ds->mode = mode;
+	ds->cat = cat;
+	ds->fresh = mode == DFA_FAST &&
+	    memcmp(set, dfa->fresh, dfa->setlen) == 0;
+	for (i = 0; i < dfa->setlen && set[i] == 0; i++)
+		continue;
+	ds->dead = mode == DFA_SLOW && i == dfa->setlen;
+	ds->hnext = dfa->hash[h & (DFA_NHASH-1)];
+	dfa->hash[h & (DFA_NHASH-1)] = ds;
+	dfa->mem += len;
+	return(ds);
+}
+
+/*
+ - dfapre - states of a DFA state after any assertions before a character
+ *
+ * This is the first half of a pass through the loop in fast() or slow(),
+ * with the categories standing in for the previous character.
+ */
+static states
+dfapre(struct match *m, struct re_dstate *ds, RCHAR_T c, states st)
+{
+	struct re_guts *g = m->g;
+	const sopno gf = g->firststate+1;
+	const sopno gl = g->laststate;
+	int flag;
+	int i;
+
+	memcpy(STATEBYTES(st), ds->set, STATESIZE);
+
+	/* is there an EOL and/or BOL between lastc and c? */
+	flag = 0;
+	i = 0;
+	if (ds->cat == DC_NL || ds->cat == DC_BOL) {
+		flag = BOL;
+		i = g->nbol;
+	}
+	if ( (c == '\n' && g->cflags&REG_NEWLINE) ||
+			(c == OUT && !(m->eflags&REG_NOTEOL)) ) {
+		flag = (flag == BOL) ? BOLEOL : EOL;
+		i += g->neol;
+	}
+	for (; i > 0; i--)
+		st = step(g, gf, gl, st, flag, OUT, st);
+
+	/* how about a word boundary? */
+	if ( (flag == BOL || ds->cat == DC_NL || ds->cat == DC_OTHER) &&
+					(c != OUT && ISWORD(c)) ) {
+		flag = BOW;
+	}
+	if ( ds->cat == DC_WORD &&
+			(flag == EOL || (c != OUT && !ISWORD(c))) ) {
+		flag = EOW;
+	}
+	if (flag == BOW || flag == EOW)
+		st = step(g, gf, gl, st, flag, OUT, st);
+	return(st);
+}
+
+/*
+ - dfastep - take a DFA transition the hard way, and remember it
+ */
+static struct re_dstate *	/* NULL if no memory */
+dfastep(struct match *m, struct re_dstate *ds, RCHAR_T c, int *accp)
+{
+	struct re_guts *g = m->g;
+	struct re_dfa *dfa = g->dfa;
+	struct re_dstate *nds;
+	states st = m->st;
+	states tmp = m->tmp;
+	const sopno gf = g->firststate+1;
+	const sopno gl = g->laststate;
+	unsigned int gen;
+	int acc;
+
+	st = dfapre(m, ds, c, st);
+	acc = ISSET(st, gl) != 0;
+	ASSIGN(tmp, st);
+	if (ds->mode == DFA_FAST)
+		memcpy(STATEBYTES(st), dfa->fresh, STATESIZE);
+	else
+		CLEAR(st);
+	st = step(g, gf, gl, tmp, 0, FOLD(g, c), st);
+
+	gen = dfa->gen;
+	nds = dfastate(m, ds->mode, dfacat(m, c), STATEBYTES(st));
+	if (nds == NULL)
+		return(NULL);
+	/* ds is gone if the states were thrown away to make room */
+	if (dfa->gen == gen && (UCHAR_T)c < NC) {
+		ds->next[dfa->cmap[(UCHAR_T)c]] = nds;
+		ds->acc[dfa->cmap[(UCHAR_T)c]] = acc;
+	}
+	*accp = acc;
+	return(nds);
+}
+
+/*
+ - dfarun - fast() or slow() over the whole expression, using the DFA
+ */
+static int			/* 0 done, -1 no memory */
+dfarun(struct match *m, int mode, const RCHAR_T *start, const RCHAR_T *stop,
+    const RCHAR_T **endp)
+{
+	struct re_dfa *dfa = m->g->dfa;
+	struct re_dstate *ds;
+	struct re_dstate *nds;
+	states st = m->st;
+	const RCHAR_T *p;
+	const RCHAR_T *coldp;	/* last p after which no match was underway */
+	const RCHAR_T *matchp;	/* last p at which a match ended */
+	RCHAR_T c;
+	int acc;
+	int cat;
+
+	cat = dfacat(m, (start == m->beginp) ? OUT : *(start-1));
+	if ((ds = dfa->start[mode][cat]) == NULL) {
+		if ((ds = dfastate(m, mode, cat, dfa->fresh)) == NULL)
+			return(-1);
+		dfa->start[mode][cat] = ds;
+	}
+	coldp = matchp = NULL;
+	for (p = start; p < stop; p++) {
+		if (ds->fresh)
+			coldp = p;
+		c = *p;
+		if ((UCHAR_T)c < NC &&
+		    (nds = ds->next[dfa->cmap[(UCHAR_T)c]]) != NULL)
+			acc = ds->acc[dfa->cmap[(UCHAR_T)c]];
+		else if ((nds = dfastep(m, ds, c, &acc)) == NULL)
+			return(-1);
+		if (acc && p >= m->minendp) {
+			if (mode == DFA_FAST) {
+				m->coldp = coldp;
+				*endp = p+1;
+				return(0);
+			}
+			matchp = p;
+		}
+		if (nds->dead) {
+			*endp = matchp;
+			return(0);
+		}
+		ds = nds;
+	}
+
+	/* the last position, which may have no character after it */
+	if (ds->fresh)
+		coldp = p;
+	st = dfapre(m, ds, (p == m->endp) ? OUT : *p, st);
+	if (ISSET(st, m->g->laststate) && p >= m->minendp)
+		matchp = p;
+	if (mode == DFA_FAST) {
+		assert(coldp != NULL);
+		m->coldp = coldp;
+		*endp = (matchp != NULL) ? matchp+1 : NULL;
+	} else
+		*endp = matchp;
+	return(0);
+}
 
 /*
  - step - map set of states reachable before char to set reachable after
@@ -961,6 +1662,150 @@ step(struct re_guts *g,
 	return(aft);
 }
 
+/*
+ - boundary - what's between two characters, as far as the RE cares
+ */
+static int			/* BOL, EOL, BOLEOL or 0 */
+boundary(struct match *m, RCHAR_T lastc, RCHAR_T c,
+    int *np,			/* how many BOL/EOL steps */
+    int *wp)			/* BOW, EOW or 0 */
+{
+	int flag;
+
+	flag = 0;
+	*np = 0;
+	if ( (lastc == '\n' && m->g->cflags&REG_NEWLINE) ||
+			(lastc == OUT && !(m->eflags&REG_NOTBOL)) ) {
+		flag = BOL;
+		*np = m->g->nbol;
+	}
+	if ( (c == '\n' && m->g->cflags&REG_NEWLINE) ||
+			(c == OUT && !(m->eflags&REG_NOTEOL)) ) {
+		flag = (flag == BOL) ? BOLEOL : EOL;
+		*np += m->g->neol;
+	}
+	*wp = 0;
+	if ( (flag == BOL || (lastc != OUT && !ISWORD(lastc))) &&
+					(c != OUT && ISWORD(c)) )
+		*wp = BOW;
+	if ( (lastc != OUT && ISWORD(lastc)) &&
+			(flag == EOL || (c != OUT && !ISWORD(c))) )
+		*wp = EOW;
+	return(flag);
+}
+
+/*
+ - tstep - step() for states tagged with the latest start of a path to them
+ *
+ * A state is in the set if its tag isn't NULL.
+ */
+#define	TFWD(dst, src, n)	do {					\
+	if ((src)[pc] != NULL &&					\
+	    ((dst)[pc+(n)] == NULL || (dst)[pc+(n)] < (src)[pc]))	\
+		(dst)[pc+(n)] = (src)[pc];				\
+} while (0)
+#define	TBACK(dst, src, n)	do {					\
+	if ((src)[pc] != NULL &&					\
+	    ((dst)[pc-(n)] == NULL || (dst)[pc-(n)] < (src)[pc]))	\
+		(dst)[pc-(n)] = (src)[pc];				\
+} while (0)
+static void
+tstep(struct re_guts *g,
+    sopno start,			/* start state within strip */
+    sopno stop,			/* state after stop state within strip */
+    const RCHAR_T **bef,		/* tags before */
+    int flag,			/* NONCHAR flag */
+    RCHAR_T ch,			/* character code */
+    const RCHAR_T **aft)		/* tags already known after */
+{
+	cset *cs;
+	sop s;
+	RCHAR_T d;
+	sopno pc;
+	sopno look;
+	const RCHAR_T *i;
+
+	for (pc = start; pc != stop; pc++) {
+		s = g->strip[pc];
+		d = g->stripdata[pc];
+		switch (s) {
+		case OEND:
+			break;
+		case OCHAR:
+			if (ch == d)
+				TFWD(aft, bef, 1);
+			break;
+		case OBOL:
+			if (flag == BOL || flag == BOLEOL)
+				TFWD(aft, bef, 1);
+			break;
+		case OEOL:
+			if (flag == EOL || flag == BOLEOL)
+				TFWD(aft, bef, 1);
+			break;
+		case OBOW:
+			if (flag == BOW)
+				TFWD(aft, bef, 1);
+			break;
+		case OEOW:
+			if (flag == EOW)
+				TFWD(aft, bef, 1);
+			break;
+		case OANY:
+			if (!flag)
+				TFWD(aft, bef, 1);
+			break;
+		case OANYOF:
+			cs = &g->sets[d];
+			if (!flag && CHIN(cs, ch))
+				TFWD(aft, bef, 1);
+			break;
+		case OBACK_:
+		case O_BACK:
+		case OPLUS_:
+		case O_QUEST:
+		case OLPAREN:
+		case ORPAREN:
+		case O_CH:
+			TFWD(aft, aft, 1);
+			break;
+		case O_PLUS:		/* both forward and back */
+			TFWD(aft, aft, 1);
+			i = aft[pc-d];
+			TBACK(aft, aft, d);
+			if (aft[pc-d] != i)	/* reconsider loop body */
+				pc -= d + 1;
+			break;
+		case OQUEST_:
+		case OCH_:
+			TFWD(aft, aft, 1);
+			TFWD(aft, aft, d);
+			break;
+		case OOR1:
+			if (aft[pc] != NULL) {
+				for (look = 1; /**/; look += d) {
+					s = g->strip[pc+look];
+					d = g->stripdata[pc+look];
+					if (s == O_CH)
+						break;
+				}
+				TFWD(aft, aft, look);
+			}
+			break;
+		case OOR2:
+			TFWD(aft, aft, 1);
+			if (g->strip[pc+d] != O_CH)
+				TFWD(aft, aft, d);
+			break;
+		default:		/* ooooops... */
+			assert(nope);
+			break;
+		}
+	}
+}
+#undef	TFWD
+#undef	TBACK
+
 #ifdef REDEBUG
 /*
  - print - print a set of states
@@ -1030,7 +1875,20 @@ pchar(int ch)
 #undef	slow
 #undef	dissect
 #undef	backref
+#undef	backtry
+#undef	split
+#undef	boundary
+#undef	tstep
 #undef	step
 #undef	print
 #undef	at
 #undef	match
+#undef	dfainit
+#undef	dfaflush
+#undef	dfasplit
+#undef	dfacat
+#undef	dfastate
+#undef	dfapre
+#undef	dfastep
+#undef	dfarun
+#undef	backward
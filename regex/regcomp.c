@@ -91,7 +91,6 @@ static void p_b_eclass(struct parse *p, cset *cs);
 static char p_b_symbol(struct parse *p);
 static char p_b_coll_elem(struct parse *p, int endc);
 static char othercase(int ch);
-static void bothcases(struct parse *p, int ch);
 static void ordinary(struct parse *p, int ch);
 static void nonnewline(struct parse *p);
 static void repeat(struct parse *p, sopno start, int from, int to, size_t reclimit);
@@ -235,11 +234,15 @@ regcomp(regex_t *preg, const RCHAR_T *pattern, int cflags)
 	g->setbits = NULL;
 	g->ncsets = 0;
 	g->cflags = cflags;
+	if (cflags&REG_ICASE)
+		for (i = 0; i < NC; i++)
+			g->fold[i] = isupper(i) ? tolower(i) : i;
 	g->iflags = 0;
 	g->nbol = 0;
 	g->neol = 0;
 	g->must = NULL;
 	g->mlen = 0;
+	g->mprefix = 0;
 	g->nsub = 0;
 #if 0
 	g->ncategories = 1;	/* category 0 is "everything else" */
@@ -247,6 +250,8 @@ regcomp(regex_t *preg, const RCHAR_T *pattern, int cflags)
 	memset((char *)g->catspace, 0, NC*sizeof(cat_t));
 #endif
 	g->backrefs = 0;
+	g->dfa = NULL;
+	g->rev = NULL;
 
 	/* do it */
 	EMIT(OEND, 0);
@@ -926,30 +931,6 @@ othercase(int ch)
 		return(ch);
 }
 
-/*
- - bothcases - emit a dualcase version of a two-case character
- *
- * Boy, is this implementation ever a kludge...
- */
-static void
-bothcases(struct parse *p, int ch)
-{
-	RCHAR_T *oldnext = p->next;
-	RCHAR_T *oldend = p->end;
-	RCHAR_T bracket[3];
-
-	assert(othercase(ch) != ch);	/* p_bracket() would recurse */
-	p->next = bracket;
-	p->end = bracket+2;
-	bracket[0] = ch;
-	bracket[1] = ']';
-	bracket[2] = '\0';
-	p_bracket(p);
-	assert(p->next == bracket+2);
-	p->next = oldnext;
-	p->end = oldend;
-}
-
 /*
  - ordinary - emit an ordinary character
  */
@@ -960,15 +941,13 @@ ordinary(struct parse *p, int ch)
 	cat_t *cap = p->g->categories;
 */
 
-	if ((p->g->cflags&REG_ICASE) && isalpha(ch) && othercase(ch) != ch)
-		bothcases(p, ch);
-	else {
-		EMIT(OCHAR, (UCHAR_T)ch);
+	if (p->g->cflags&REG_ICASE)
+		ch = FOLD(p->g, ch);
+	EMIT(OCHAR, (UCHAR_T)ch);
 /*
-		if (cap[ch] == 0)
-			cap[ch] = p->g->ncategories++;
+	if (cap[ch] == 0)
+		cap[ch] = p->g->ncategories++;
 */
-	}
 }
 
 /*
@@ -1496,7 +1475,7 @@ stripsnug(struct parse *p, struct re_guts *g)
 }
 
 /*
- - findmust - fill in must and mlen with longest mandatory literal string
+ - findmust - fill in must, mlen, mprefix and mfold with longest mandatory literal string
  *
  * This algorithm could do fancy things like analyzing the operands of |
  * for common subsequences.  Someday.  This code is simple and finds most
@@ -1518,6 +1497,7 @@ findmust(struct parse *p, struct re_guts *g)
 	RCHAR_T d;
 	RCHAR_T *cp;
 	sopno i;
+	int b;
 
 	/* avoid making error situations worse */
 	if (p->error != 0)
@@ -1572,6 +1552,13 @@ findmust(struct parse *p, struct re_guts *g)
 	if (g->mlen == 0)		/* there isn't one */
 		return;
 
+	/* is it ahead of anything that could match a character? */
+	for (scans = g->strip + 1; scans < starts; scans++)
+		if (*scans != OPLUS_ && *scans != OLPAREN &&
+		    *scans != ORPAREN && *scans != OBOL && *scans != OBOW)
+			break;
+	g->mprefix = (scans == starts);
+
 	/* turn it into a character string */
 	g->must = malloc(((size_t)g->mlen + 1) * sizeof(RCHAR_T));
 	if (g->must == NULL) {		/* argh; just forget it */
@@ -1593,6 +1580,29 @@ findmust(struct parse *p, struct re_guts *g)
 	}
 	assert(cp == g->must + g->mlen);
 	*cp++ = '\0';		/* just on general principles */
+
+	/*
+	 * The prescreen looks for the first and last characters of must
+	 * before comparing the rest, so with REG_ICASE it needs to know the
+	 * characters that fold to them.  Just forget it if there's more than
+	 * one other such character, which no sane locale has.
+	 */
+	for (i = 0; i < 2; i++) {
+		d = g->must[i == 0 ? 0 : g->mlen - 1];
+		g->mfold[i] = d;
+		if (!(g->cflags&REG_ICASE))
+			continue;
+		for (b = 0; b < NC; b++)
+			if ((RCHAR_T)b != d && FOLD(g, (RCHAR_T)b) == d) {
+				if (g->mfold[i] != d) {
+					free(g->must);
+					g->must = NULL;
+					g->mlen = 0;
+					return;
+				}
+				g->mfold[i] = (RCHAR_T)b;
+			}
+	}
 }
 
 /*
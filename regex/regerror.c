@@ -78,6 +78,7 @@ static char *regatoi(const regex_t *preg, char *localbuf);
  = #define	REG_EMPTY	14
  = #define	REG_ASSERT	15
  = #define	REG_INVARG	16
+ = #define	REG_ESTEPS	17
  = #define	REG_ATOI	255	// convert name to number (!)
  = #define	REG_ITOA	0400	// convert number to name (!)
  */
@@ -102,6 +103,7 @@ static struct rerr {
 	{ REG_EMPTY,	"REG_EMPTY",	"empty (sub)expression" },
 	{ REG_ASSERT,	"REG_ASSERT",	"\"can't happen\" -- you found a bug" },
 	{ REG_INVARG,	"REG_INVARG",	"invalid argument to regex routine" },
+	{ REG_ESTEPS,	"REG_ESTEPS",	"backtracking limit exceeded" },
 	{ 0,		"",		"*** unknown regexp error code ***" },
 };
 
@@ -141,6 +141,7 @@ struct re_guts {
 	cset *sets;		/* -> cset [ncsets] */
 	uch *setbits;		/* -> uch[csetsize][ncsets/CHAR_BIT] */
 	int cflags;		/* copy of regcomp() cflags argument */
+	uch fold[NC];		/* byte -> its lower case, if REG_ICASE */
 	sopno nstates;		/* = number of sops */
 	sopno firststate;	/* the initial OEND (normally 0) */
 	sopno laststate;	/* the final OEND */
@@ -156,15 +157,83 @@ struct re_guts {
 #endif
 	RCHAR_T *must;		/* match must contain this string */
 	size_t mlen;		/* length of must */
+	int mprefix;		/* does every match start with must? */
+	RCHAR_T mfold[2];	/* other case of must's first, last chars */
 	size_t nsub;		/* copy of re_nsub */
 	int backrefs;		/* does it use back references? */
 	sopno nplus;		/* how deep does it nest +s? */
+	struct re_dfa *dfa;	/* lazily built DFA, or NULL */
+	struct re_guts *rev;	/* lazily built reversal, or NULL */
 	/* catspace must be last */
 #if 0
 	cat_t catspace[1];	/* actually [NC] */
 #endif
 };
 
+/*
+ * Lazily built DFA, shared by all regexec() calls on an expression that
+ * has no back references (see engine.c).  A DFA state is a set of NFA
+ * states, the category of the character preceding it, and the matcher
+ * (fast or slow) it belongs to.  Characters that fit in a byte are mapped
+ * to classes of characters the expression can't tell apart, and each DFA
+ * state has a table of next states by class, filled in the first time the
+ * transition is taken.  Wider characters are stepped through the NFA.
+ * If the states come to use more than DFA_MAXMEM bytes, they're all
+ * thrown away and the DFA is rebuilt as it's used.
+ */
+#define	DFA_MAXMEM	(1024*1024)	/* memory budget for states */
+#define	DFA_NHASH	256		/* hash chains, a power of 2 */
+#define	DFA_FAST	0		/* modes */
+#define	DFA_SLOW	1
+#define	DC_BOL		0		/* previous character categories */
+#define	DC_NOBOL	1		/* start of string, REG_NOTBOL */
+#define	DC_NL		2		/* newline, REG_NEWLINE */
+#define	DC_WORD		3
+#define	DC_OTHER	4
+#define	DC_NCAT		5
+
+struct re_dstate {
+	struct re_dstate *hnext;	/* hash chain */
+	struct re_dstate **next;	/* -> [nclass] next state, or NULL */
+	uch *acc;		/* -> [nclass] match ends before class? */
+	uch *set;		/* -> [setlen] NFA states */
+	unsigned int hash;	/* hash of mode, cat and set */
+	uch mode;		/* DFA_FAST or DFA_SLOW */
+	uch cat;		/* category of preceding character */
+	uch fresh;		/* set is the fresh set (DFA_FAST) */
+	uch dead;		/* set is empty (DFA_SLOW) */
+};
+
+struct re_dfa {
+	int rep;		/* state set representation */
+	size_t setlen;		/* bytes in a set of NFA states */
+	int nclass;		/* number of character classes */
+	uch cmap[NC];		/* byte -> character class */
+	uch *fresh;		/* -> [setlen] states for a fresh start */
+	size_t mem;		/* bytes used by states */
+	unsigned int gen;	/* bumped when the states are discarded */
+	struct re_dstate *start[2][DC_NCAT];	/* start states */
+	struct re_dstate *hash[DFA_NHASH];
+};
+
+/*
+ * Limits on the backtracking search for expressions with back references
+ * (see backref() in engine.c).
+ */
+#define	BR_MAXSTEPS	50000000 /* give up after this many calls */
+#define	BR_MEMOSTEPS	100000	/* remember failures after this many */
+#define	BR_NMEMO	4096	/* failures remembered */
+#define	BR_NHASH	1024	/* hash chains, a power of 2 */
+
 /* misc utilities */
 #define OUT	REOF	/* a non-character value */
 #define	ISWORD(c) ((c) == '_' || (ISGRAPH((UCHAR_T)c) && !ISPUNCT((UCHAR_T)c)))
+
+/*
+ * With REG_ICASE, literals are compiled in lower case, and characters of
+ * the string are folded to lower case as they're matched against them.
+ * Bracket expressions contain both cases, so it doesn't matter which is
+ * matched against them.  Characters that don't fit in a byte aren't folded.
+ */
+#define	FOLD(g, c)	(((g)->cflags&REG_ICASE) && (UCHAR_T)(c) < NC ? \
+			    (RCHAR_T)(g)->fold[(UCHAR_T)(c)] : (c))
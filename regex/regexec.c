@@ -42,8 +42,8 @@ static char sccsid[] = "@(#)regexec.c	8.2 (Berkeley) 3/16/94";
 /*
  * the outer shell of regexec()
  *
- * This file includes engine.c *twice*, after muchos fiddling with the
- * macros that code uses.  This lets the same code operate on two different
+ * This file includes engine.c *three times*, after muchos fiddling with the
+ * macros that code uses.  This lets the same code operate on three different
  * representations for state sets.
  */
 #include <sys/types.h>
@@ -53,10 +53,226 @@ static char sccsid[] = "@(#)regexec.c	8.2 (Berkeley) 3/16/94";
 #include <limits.h>
 #include <ctype.h>
 #include <regex.h>
+#include <strings.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "utils.h"
 #include "regex2.h"
 
+/*
+ - mustcmp - does the must string start here?
+ */
+static int
+mustcmp(const struct re_guts *g, const RCHAR_T *dp)
+{
+	size_t i;
+
+	if (!(g->cflags&REG_ICASE))
+		return(MEMCMP(dp, g->must, g->mlen) == 0);
+	for (i = 0; i < g->mlen; i++)
+		if (FOLD(g, dp[i]) != g->must[i])
+			return(0);
+	return(1);
+}
+
+/*
+ - mustscan - find the first occurrence of the must string
+ *
+ * Every line searched is prescreened for the must string, so where the
+ * compiler targets it, the string's first and last characters (in either
+ * case, with REG_ICASE) are looked for a vector at a time, which turns
+ * away nearly all of the false starts before they get to mustcmp().
+ */
+static const RCHAR_T *		/* NULL if there isn't one */
+mustscan(const struct re_guts *g, const RCHAR_T *start, const RCHAR_T *stop)
+{
+	const RCHAR_T *must = g->must;
+	size_t mlen = g->mlen;
+	const RCHAR_T *dp;
+	const RCHAR_T *last;	/* last place it could start */
+
+	if ((size_t)(stop - start) < mlen)
+		return(NULL);
+	last = stop - mlen;
+	dp = start;
+#if defined(USE_WIDECHAR) && __SIZEOF_WCHAR_T__ == 4
+#if defined(__AVX2__)
+	{
+		__m256i f, ff, l, lf, v, f0;
+		u_int32_t m;
+
+		f = _mm256_set1_epi32(must[0]);
+		ff = _mm256_set1_epi32(g->mfold[0]);
+		l = _mm256_set1_epi32(must[mlen-1]);
+		lf = _mm256_set1_epi32(g->mfold[1]);
+		for (; last - dp >= 7; dp += 8) {
+			v = _mm256_loadu_si256((const __m256i *)dp);
+			f0 = _mm256_or_si256(_mm256_cmpeq_epi32(f, v),
+			    _mm256_cmpeq_epi32(ff, v));
+			v = _mm256_loadu_si256((const __m256i *)(dp+mlen-1));
+			m = (u_int32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+			    _mm256_and_si256(f0, _mm256_or_si256(
+			    _mm256_cmpeq_epi32(l, v),
+			    _mm256_cmpeq_epi32(lf, v)))));
+			for (; m != 0; m &= m - 1)
+				if (mustcmp(g, dp + ffs((int)m) - 1))
+					return(dp + ffs((int)m) - 1);
+		}
+	}
+#elif defined(__SSE2__)
+	{
+		__m128i f, ff, l, lf, v, f0;
+		u_int32_t m;
+
+		f = _mm_set1_epi32(must[0]);
+		ff = _mm_set1_epi32(g->mfold[0]);
+		l = _mm_set1_epi32(must[mlen-1]);
+		lf = _mm_set1_epi32(g->mfold[1]);
+		for (; last - dp >= 3; dp += 4) {
+			v = _mm_loadu_si128((const __m128i *)dp);
+			f0 = _mm_or_si128(_mm_cmpeq_epi32(f, v),
+			    _mm_cmpeq_epi32(ff, v));
+			v = _mm_loadu_si128((const __m128i *)(dp+mlen-1));
+			m = (u_int32_t)_mm_movemask_ps(_mm_castsi128_ps(
+			    _mm_and_si128(f0, _mm_or_si128(
+			    _mm_cmpeq_epi32(l, v),
+			    _mm_cmpeq_epi32(lf, v)))));
+			for (; m != 0; m &= m - 1)
+				if (mustcmp(g, dp + ffs((int)m) - 1))
+					return(dp + ffs((int)m) - 1);
+		}
+	}
+#endif
+#endif
+	for (; dp <= last; dp++)
+		if ((*dp == must[0] || *dp == g->mfold[0]) && mustcmp(g, dp))
+			return(dp);
+	return(NULL);
+}
+
+/*
+ - revop - copy a strip operator into the reversed strip
+ */
+static void
+revop(const struct re_guts *g, struct re_guts *r, sopno pc, sopno to)
+{
+	r->strip[to] = g->strip[pc];
+	r->stripdata[to] = g->stripdata[pc];
+}
+
+/*
+ - revseq - reverse a sequence of strip operators into the reversed strip
+ *
+ * Each operator, or construct of operators, moves to the mirror image of
+ * its place.  A construct keeps its shape, since its operands are offsets
+ * within it, and only its body, or the body of each of its branches, is
+ * reversed in turn.  Anchors turn into their opposites, and parentheses
+ * are turned around; the matchers don't look at their operands.
+ */
+static void
+revseq(const struct re_guts *g, struct re_guts *r, sopno from, sopno to,
+    sopno dst)
+{
+	sopno pc, end, o, q, n, e;
+	sop s;
+
+	for (pc = from; pc < to; pc = end) {
+		s = g->strip[pc];
+		end = pc + 1;
+		if (s == OPLUS_ || s == OQUEST_)
+			end = pc + g->stripdata[pc] + 1;
+		else if (s == OCH_) {
+			for (end = pc; g->strip[end] != O_CH;
+			    end += g->stripdata[end])
+				continue;
+			end++;
+		}
+		o = dst + (to - end);	/* where it goes */
+
+		switch (s) {
+		case OPLUS_:
+		case OQUEST_:
+			revop(g, r, pc, o);
+			revseq(g, r, pc + 1, end - 1, o + 1);
+			revop(g, r, end - 1, o + (end - 1 - pc));
+			break;
+		case OCH_:
+			/* q is the OCH_ or OOR2 before each branch */
+			for (q = pc;; q = n) {
+				n = q + g->stripdata[q];
+				e = (g->strip[n] == O_CH) ? n : n - 1;
+				revop(g, r, q, o + (q - pc));
+				revseq(g, r, q + 1, e, o + (q + 1 - pc));
+				revop(g, r, e, o + (e - pc));
+				if (e == n)
+					break;
+			}
+			break;
+		default:
+			revop(g, r, pc, o);
+			switch (s) {
+			case OBOL:	r->strip[o] = OEOL;	break;
+			case OEOL:	r->strip[o] = OBOL;	break;
+			case OBOW:	r->strip[o] = OEOW;	break;
+			case OEOW:	r->strip[o] = OBOW;	break;
+			case OLPAREN:	r->strip[o] = ORPAREN;	break;
+			case ORPAREN:	r->strip[o] = OLPAREN;	break;
+			}
+			break;
+		}
+	}
+}
+
+/*
+ - revguts - the expression reversed, for REG_BACKWARD
+ *
+ * It's built the first time it's needed, and kept, like the DFA.  It has
+ * no must string, and shares the character sets with the original.  Back
+ * references can't be run backwards, so an expression with them has none.
+ */
+static struct re_guts *		/* NULL if none */
+revguts(struct re_guts *g)
+{
+	struct re_guts *r;
+
+	if (g->rev != NULL || g->backrefs)
+		return(g->rev);
+	r = (struct re_guts *)malloc(sizeof(struct re_guts));
+	if (r == NULL)
+		return(NULL);
+	*r = *g;
+	r->strip = (sop *)malloc(g->nstates * sizeof(sop));
+	r->stripdata = (RCHAR_T *)malloc(g->nstates * sizeof(RCHAR_T));
+	if (r->strip == NULL || r->stripdata == NULL) {
+		free(r->strip);
+		free(r->stripdata);
+		free(r);
+		return(NULL);
+	}
+	memcpy(r->strip, g->strip, g->nstates * sizeof(sop));
+	memcpy(r->stripdata, g->stripdata, g->nstates * sizeof(RCHAR_T));
+	revseq(g, r, g->firststate+1, g->laststate, g->firststate+1);
+	r->iflags = g->iflags & ~(USEBOL|USEEOL);
+	if (g->iflags&USEBOL)
+		r->iflags |= USEEOL;
+	if (g->iflags&USEEOL)
+		r->iflags |= USEBOL;
+	r->nbol = g->neol;
+	r->neol = g->nbol;
+	r->must = NULL;
+	r->mlen = 0;
+	r->mprefix = 0;
+	r->dfa = NULL;
+	r->rev = NULL;
+	g->rev = r;
+	return(r);
+}
+
 /* macros for manipulating states, small version */
 #define	states	int
 #define	states1	int		/* for later use in regexec() decision */
@@ -79,6 +295,10 @@ static char sccsid[] = "@(#)regexec.c	8.2 (Berkeley) 3/16/94";
 #define	FWD(dst, src, n)	((dst) |= ((unsigned)(src)&(here)) << (n))
 #define	BACK(dst, src, n)	((dst) |= ((unsigned)(src)&(here)) >> (n))
 #define	ISSETBACK(v, n)	((v) & ((unsigned)here >> (n)))
+/* the bytes of a set of states, for the DFA */
+#define	STATEREP	0
+#define	STATESIZE	sizeof(states1)
+#define	STATEBYTES(v)	((uch *)&(v))
 /* function names */
 #define SNAMES			/* engine.c looks after details */
 
@@ -103,8 +323,112 @@ static char sccsid[] = "@(#)regexec.c	8.2 (Berkeley) 3/16/94";
 #undef	FWD
 #undef	BACK
 #undef	ISSETBACK
+#undef	STATEREP
+#undef	STATESIZE
+#undef	STATEBYTES
 #undef	SNAMES
 
+/*
+ * The medium version keeps up to MSTATES states as a bit vector the size
+ * of a vector register or two, so expressions too big for an int, such as
+ * alternations of a few dozen keywords, are still matched a bit per state.
+ */
+#define	MSTATES	256
+#define	MWORDS	(MSTATES / 64)
+typedef struct {
+	u_int64_t w[MWORDS];
+} mstates;
+
+/*
+ - mstateseq - are two medium sets of states the same?
+ */
+static int
+mstateseq(mstates a, mstates b)
+{
+#if defined(__AVX2__)
+	__m256i x;
+
+	x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)a.w),
+	    _mm256_loadu_si256((const __m256i *)b.w));
+	return(_mm256_testz_si256(x, x));
+#elif defined(__SSE2__)
+	__m128i x;
+
+	x = _mm_or_si128(
+	    _mm_xor_si128(_mm_loadu_si128((const __m128i *)a.w),
+	    _mm_loadu_si128((const __m128i *)b.w)),
+	    _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a.w + 2)),
+	    _mm_loadu_si128((const __m128i *)(b.w + 2))));
+	return(_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) ==
+	    0xffff);
+#else
+	int i;
+
+	for (i = 0; i < MWORDS; i++)
+		if (a.w[i] != b.w[i])
+			return(0);
+	return(1);
+#endif
+}
+
+/* macros for manipulating states, medium version */
+#define	states	mstates
+#define	MBIT(n)	((u_int64_t)1 << ((n) & 63))
+#define	CLEAR(v)	memset(&(v), 0, sizeof(mstates))
+#define	SET0(v, n)	((v).w[(n) >> 6] &= ~MBIT(n))
+#define	SET1(v, n)	((v).w[(n) >> 6] |= MBIT(n))
+#define	ISSET(v, n)	(((v).w[(n) >> 6] & MBIT(n)) != 0)
+#define	ASSIGN(d, s)	((d) = (s))
+#define	EQ(a, b)	mstateseq(a, b)
+#define	STATEVARS	int dummy	/* dummy version */
+#define	STATESETUP(m, n)	/* nothing */
+#define	STATETEARDOWN(m)	/* nothing */
+#define	SETUP(v)	CLEAR(v)
+#define	onestate	int
+#define	INIT(o, n)	((o) = (n))
+#define	INC(o)	((o)++)
+#define	ISSTATEIN(v, o)	ISSET(v, o)
+/* some abbreviations; note that some of these know variable names! */
+/* do "if I'm here, I can also be there" etc without branches */
+#define	FWD(dst, src, n)	((dst).w[(here+(n)) >> 6] |= \
+				(u_int64_t)ISSET(src, here) << ((here+(n)) & 63))
+#define	BACK(dst, src, n)	((dst).w[(here-(n)) >> 6] |= \
+				(u_int64_t)ISSET(src, here) << ((here-(n)) & 63))
+#define	ISSETBACK(v, n)	ISSET(v, here - (n))
+/* the bytes of a set of states, for the DFA */
+#define	STATEREP	1
+#define	STATESIZE	sizeof(mstates)
+#define	STATEBYTES(v)	((uch *)&(v))
+/* function names */
+#define	MNAMES			/* flag */
+
+#include "engine.c"
+
+/* now undo things */
+#undef	states
+#undef	MBIT
+#undef	CLEAR
+#undef	SET0
+#undef	SET1
+#undef	ISSET
+#undef	ASSIGN
+#undef	EQ
+#undef	STATEVARS
+#undef	STATESETUP
+#undef	STATETEARDOWN
+#undef	SETUP
+#undef	onestate
+#undef	INIT
+#undef	INC
+#undef	ISSTATEIN
+#undef	FWD
+#undef	BACK
+#undef	ISSETBACK
+#undef	STATEREP
+#undef	STATESIZE
+#undef	STATEBYTES
+#undef	MNAMES
+
 /* macros for manipulating states, large version */
 #define	states	char *
 #define	CLEAR(v)	memset(v, 0, m->g->nstates)
@@ -128,6 +452,10 @@ static char sccsid[] = "@(#)regexec.c	8.2 (Berkeley) 3/16/94";
 #define	FWD(dst, src, n)	((dst)[here+(n)] |= (src)[here])
 #define	BACK(dst, src, n)	((dst)[here-(n)] |= (src)[here])
 #define	ISSETBACK(v, n)	((v)[here - (n)])
+/* the bytes of a set of states, for the DFA */
+#define	STATEREP	2
+#define	STATESIZE	((size_t)m->g->nstates)
+#define	STATEBYTES(v)	((uch *)(v))
 /* function names */
 #define	LNAMES			/* flag */
 
@@ -140,10 +468,15 @@ static char sccsid[] = "@(#)regexec.c	8.2 (Berkeley) 3/16/94";
  = #define	REG_NOTBOL	00001
  = #define	REG_NOTEOL	00002
  = #define	REG_STARTEND	00004
+ = #define	REG_BACKWARD	00010	// find the match that starts last
  = #define	REG_TRACE	00400	// tracing of execution
  = #define	REG_LARGE	01000	// force large representation
  = #define	REG_BACKR	02000	// force use of backref code
  *
+ * With REG_BACKWARD, the match found is the one that starts last.  With
+ * REG_STARTEND as well, the string starts at string, as usual, and rm_so
+ * is the last place the match can start, not the start of the string.
+ *
  * We put this here so we can exploit knowledge of the state representation
  * when choosing which matcher to call.  Also, by this point the matchers
  * have been prototyped.
@@ -156,7 +489,8 @@ regexec(const regex_t *preg, const RCHAR_T *string, size_t nmatch,
 #ifdef REDEBUG
 #	define	GOODFLAGS(f)	(f)
 #else
-#	define	GOODFLAGS(f)	((f)&(REG_NOTBOL|REG_NOTEOL|REG_STARTEND))
+#	define	GOODFLAGS(f)	((f)&(REG_NOTBOL|REG_NOTEOL|REG_STARTEND| \
+				    REG_BACKWARD))
 #endif
 
 	if (preg->re_magic != MAGIC1 || g->magic != MAGIC2)
@@ -165,9 +499,13 @@ regexec(const regex_t *preg, const RCHAR_T *string, size_t nmatch,
 	if (g->iflags&BAD)		/* backstop for no-debug case */
 		return(REG_BADPAT);
 	eflags = GOODFLAGS(eflags);
+	if (eflags&REG_BACKWARD && revguts(g) == NULL && !g->backrefs)
+		return(REG_ESPACE);
 
 	if (g->nstates <= (int)(CHAR_BIT*sizeof(states1)) && !(eflags&REG_LARGE))
 		return(smatcher(g, string, nmatch, pmatch, eflags));
+	else if (g->nstates <= MSTATES && !(eflags&REG_LARGE))
+		return(mmatcher(g, string, nmatch, pmatch, eflags));
 	else
 		return(lmatcher(g, string, nmatch, pmatch, eflags));
 }
@@ -40,6 +40,7 @@ static char sccsid[] = "@(#)regfree.c	8.2 (Berkeley) 3/16/94";
 #endif /* LIBC_SCCS and not lint */
 
 #include <sys/types.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <regex.h>
@@ -47,6 +48,23 @@ static char sccsid[] = "@(#)regfree.c	8.2 (Berkeley) 3/16/94";
 #include "utils.h"
 #include "regex2.h"
 
+/*
+ - dfafree - free a DFA and its states
+ */
+static void
+dfafree(struct re_dfa *dfa)
+{
+	struct re_dstate *ds, *nds;
+	int i;
+
+	for (i = 0; i < DFA_NHASH; i++)
+		for (ds = dfa->hash[i]; ds != NULL; ds = nds) {
+			nds = ds->hnext;
+			free(ds);
+		}
+	free(dfa);
+}
+
 /*
  - regfree - free everything
  */
@@ -74,5 +92,14 @@ regfree(regex_t *preg)
 		free((char *)g->setbits);
 	if (g->must != NULL)
 		free(g->must);
+	if (g->dfa != NULL)
+		dfafree(g->dfa);
+	if (g->rev != NULL) {		/* shares the sets with g */
+		free((char *)g->rev->strip);
+		free((char *)g->rev->stripdata);
+		if (g->rev->dfa != NULL)
+			dfafree(g->rev->dfa);
+		free((char *)g->rev);
+	}
 	free((char *)g);
 }
@@ -91,7 +91,7 @@ int
 v_join(SCR *sp, VICMD *vp)
 {
 	EXCMD cmd;
-	int lno;
+	recno_t lno;
 
 	/*
 	 * YASC.
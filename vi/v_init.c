@@ -88,6 +88,8 @@ v_screen_end(SCR *sp)
 	free(vip->rep);
 	free(vip->mcs);
 	free(vip->ps);
+	free(vip->is_mp);
+	free(vip->is_np);
 
 	free(HMAP);
 
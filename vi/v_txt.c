@@ -35,6 +35,7 @@ static int	 txt_fc(SCR *, TEXT *, int *);
 static int	 txt_fc_col(SCR *, int, ARGS **);
 static int	 txt_hex(SCR *, TEXT *);
 static int	 txt_insch(SCR *, TEXT *, CHAR_T *, u_int);
+static int	 txt_isext(CHAR_T *, size_t, CHAR_T *, size_t);
 static int	 txt_isrch(SCR *, VICMD *, TEXT *, u_int8_t *);
 static int	 txt_map_end(SCR *);
 static int	 txt_map_init(SCR *);
@@ -458,6 +459,7 @@ newtp:		if ((tp = text_init(sp, lp, len, len + 32)) == NULL)
 	nochange = 0;
 	FL_INIT(is_flags,
 	    LF_ISSET(TXT_SEARCHINCR) ? IS_RESTART | IS_RUNNING : 0);
+	vip->is_mlen = vip->is_nlen = 0;
 	filec_redraw = hexcnt = showmatch = 0;
 
 	/* Initialize input flags. */
@@ -2515,6 +2517,22 @@ txt_insch(SCR *sp, TEXT *tp, CHAR_T *chp, u_int flags)
 	return (0);
 }
 
+/*
+ * txt_isext --
+ *	Return if an incremental search pattern is another one with more
+ *	characters added, none of which change the meaning of the other.
+ */
+static int
+txt_isext(CHAR_T *op, size_t olen, CHAR_T *p, size_t len)
+{
+	if (olen == 0 || olen > len || MEMCMP(op, p, olen))
+		return (0);
+	for (p += olen, len -= olen; len > 0; ++p, --len)
+		if (STRCHR(L("\\*+?{|~"), *p) || *p == '\0')
+			return (0);
+	return (1);
+}
+
 /*
  * txt_isrch --
  *	Do an incremental search.
@@ -2522,9 +2540,14 @@ txt_insch(SCR *sp, TEXT *tp, CHAR_T *chp, u_int flags)
 static int
 txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
 {
+	VI_PRIVATE *vip;
 	MARK start;
 	recno_t lno;
+	size_t len;
 	u_int sf;
+	CHAR_T *p;
+
+	vip = VIP(sp);
 
 	/* If it's a one-line screen, we don't do incrementals. */
 	if (IS_ONELINE(sp)) {
@@ -2538,6 +2561,7 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
 	 */
 	if (tp->cno <= 1) {
 		vp->m_final = vp->m_start;
+		vip->is_mlen = 0;
 		return (0);
 	}
 
@@ -2570,7 +2594,31 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
 		FL_CLR(*is_flagsp, IS_RUNNING);
 		return (0);
 	}
-		
+
+	/*
+	 * Adding characters to the end of a pattern, other than ones that
+	 * repeat, alternate or quote what comes before them, can only make
+	 * it match less: each match of the longer pattern starts with a
+	 * match of the shorter one.  So, if the pattern extends one that
+	 * didn't match, it doesn't match either.  If it extends the pattern
+	 * whose first match, from the starting point, is at the cursor, its
+	 * first match can't come before the cursor, and the lines between
+	 * the starting point and the cursor are already known not to match.
+	 */
+	p = tp->lb + 1;
+	len = tp->cno - 1;
+	if (txt_isext(vip->is_np, vip->is_nlen, p, len)) {
+		FL_SET(*is_flagsp, IS_RESTART);
+		return (0);
+	}
+
+	/*
+	 * If the user has typed ahead, the search would be for a pattern
+	 * that's already out of date, wait for the next one.
+	 */
+	if (KEYS_WAITING(sp))
+		return (0);
+
 	/*
 	 * Remember the input line and discard the special input map,
 	 * but don't overwrite the input line on the screen.
@@ -2587,29 +2635,47 @@ txt_isrch(SCR *sp, VICMD *vp, TEXT *tp, u_int8_t *is_flagsp)
 	 * beep the screen.  When searching from the original cursor position, 
 	 * we have to move the cursor, otherwise, we don't want to move the
 	 * cursor in case the text at the current position continues to match.
+	 * If the user types a key before the search finishes, give up on it,
+	 * and leave everything as it was.
 	 */
-	if (FL_ISSET(*is_flagsp, IS_RESTART)) {
-		start = vp->m_start;
-		sf = SEARCH_SET;
-	} else {
+	if (!FL_ISSET(*is_flagsp, IS_RESTART) &&
+	    txt_isext(vip->is_mp, vip->is_mlen, p, len)) {
 		start = vp->m_final;
-		sf = SEARCH_INCR | SEARCH_SET;
+		sf = SEARCH_INCR | SEARCH_KEYS | SEARCH_SET;
+		sp->isrch_lno = vp->m_start.lno;
+	} else {
+		start = vp->m_start;
+		sf = SEARCH_KEYS | SEARCH_SET;
 	}
 
 	if (tp->lb[0] == '/' ?
-	    !f_search(sp,
-	    &start, &vp->m_final, tp->lb + 1, tp->cno - 1, NULL, sf) :
-	    !b_search(sp,
-	    &start, &vp->m_final, tp->lb + 1, tp->cno - 1, NULL, sf)) {
+	    !f_search(sp, &start, &vp->m_final, p, len, NULL, sf) :
+	    !b_search(sp, &start, &vp->m_final, p, len, NULL, sf)) {
 		sp->lno = vp->m_final.lno;
 		sp->cno = vp->m_final.cno;
 		FL_CLR(*is_flagsp, IS_RESTART);
 
+		BINC_RETW(sp, vip->is_mp, vip->is_mblen, len);
+		MEMCPY(vip->is_mp, p, len);
+		vip->is_mlen = len;
+
 		if (!KEYS_WAITING(sp) && vs_refresh(sp, 0))
 			return (1);
-	} else
+	} else if (!KEYS_WAITING(sp)) {
 		FL_SET(*is_flagsp, IS_RESTART);
 
+		/*
+		 * Remember the pattern didn't match, unless the search was
+		 * interrupted, or the pattern isn't a valid RE yet.
+		 */
+		if (!F_ISSET(sp->gp, G_INTERRUPTED) &&
+		    F_ISSET(sp, SC_RE_SEARCH)) {
+			BINC_RETW(sp, vip->is_np, vip->is_nblen, len);
+			MEMCPY(vip->is_np, p, len);
+			vip->is_nlen = len;
+		}
+	}
+
 	/* Reinstantiate the special input map. */
 	if (txt_map_init(sp))
 		return (1);
@@ -264,6 +264,14 @@ typedef struct _vi_private {
 	CHAR_T	lastckey;	/* Last search character. */
 	cdir_t	csearchdir;	/* Character search direction. */
 
+				/* Incremental search state. */
+	CHAR_T *is_mp;		/* Pattern first matched at the cursor. */
+	size_t	is_mlen;	/* Pattern length. */
+	size_t	is_mblen;	/* Pattern buffer length. */
+	CHAR_T *is_np;		/* Pattern that doesn't match. */
+	size_t	is_nlen;	/* Pattern length. */
+	size_t	is_nblen;	/* Pattern buffer length. */
+
 	SMAP   *h_smap;		/* First slot of the line map. */
 	SMAP   *t_smap;		/* Last slot of the line map. */
 
@@ -334,8 +334,13 @@ small_fill:			(void)gp->scr_move(sp, LASTLINE(sp), 0);
 		/*
 		 * If less than a half screen from the bottom of the file,
 		 * put the last line of the file on the bottom of the screen.
+		 * If there's a screenful of lines after the line, it can't
+		 * be, and there's no need to find the last line, which may
+		 * mean waiting for the file to load.
 		 */
-bottom:		if (db_last(sp, &lastline))
+bottom:		if (db_exist(sp, LNO + sp->t_rows))
+			goto middle;
+		if (db_last(sp, &lastline))
 			return (1);
 		tmp.lno = LNO;
 		tmp.coff = HMAP->coff;
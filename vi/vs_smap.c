@@ -24,7 +24,7 @@
 
 static int	vs_deleteln(SCR *, int);
 static int	vs_insertln(SCR *, int);
-static int	vs_sm_delete(SCR *, recno_t);
+static int	vs_sm_delete(SCR *, recno_t, recno_t);
 static int	vs_sm_down(SCR *, MARK *, recno_t, scroll_t, SMAP *);
 static int	vs_sm_erase(SCR *);
 static int	vs_sm_insert(SCR *, recno_t);
@@ -39,10 +39,26 @@ static int	vs_sm_up(SCR *, MARK *, recno_t, scroll_t, SMAP *);
  */
 int
 vs_change(SCR *sp, recno_t lno, lnop_t op)
+{
+	return (vs_nchange(sp, lno, op, 1));
+}
+
+/*
+ * vs_nchange --
+ *	Make a change of cnt lines to the screen.  Inserted lines are
+ *	numbered from lno, deleted and reset lines are the lines from lno
+ *	on.  The screen ends up the same as if the lines were changed one
+ *	at a time.
+ *
+ * PUBLIC: int vs_nchange(SCR *, recno_t, lnop_t, recno_t);
+ */
+int
+vs_nchange(SCR *sp, recno_t lno, lnop_t op, recno_t cnt)
 {
 	VI_PRIVATE *vip;
 	SMAP *p;
-	size_t cnt, oldy, oldx;
+	recno_t n;
+	size_t oldy, oldx;
 
 	vip = VIP(sp);
 
@@ -53,15 +69,19 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
 	 * an "empty" file.  If we "insert" a line, that line gets scrolled
 	 * down, not repainted, so it's incorrect when we refresh the screen.
 	 * The vi text input functions detect it explicitly and don't insert
-	 * a new line.
+	 * a new line.  Any other lines added are inserted after it.
 	 *
 	 * Check for line #2 before going to the end of the file.
 	 */
 	if (((op == LINE_APPEND && lno == 0) || 
 	    (op == LINE_INSERT && lno == 1)) &&
-	    !db_exist(sp, 2)) {
-		lno = 1;
-		op = LINE_RESET;
+	    !db_exist(sp, cnt + 1)) {
+		if (vs_nchange(sp, 1, LINE_RESET, 1))
+			return (1);
+		if (--cnt == 0)
+			return (0);
+		lno = 2;
+		op = LINE_INSERT;
 	}
 
 	/* Appending is the same as inserting, if the line is incremented. */
@@ -77,7 +97,8 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
 	/*
 	 * If the line is before the map, and it's a decrement, decrement
 	 * the map.  If it's an increment, increment the map.  Otherwise,
-	 * ignore it.
+	 * ignore it.  Any deleted lines that weren't before the map are
+	 * then at the top of it.
 	 */
 	if (lno < HMAP->lno) {
 		switch (op) {
@@ -85,33 +106,41 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
 			abort();
 			/* NOTREACHED */
 		case LINE_DELETE:
-			for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
-				--p->lno;
+			n = MIN(cnt, HMAP->lno - lno);
+			for (p = HMAP; p <= TMAP; ++p)
+				p->lno -= n;
 			if (sp->lno >= lno)
-				--sp->lno;
+				sp->lno = sp->lno - lno < n ?
+				    lno - 1 : sp->lno - n;
 			F_SET(vip, VIP_N_RENUMBER);
+			if ((cnt -= n) == 0)
+				return (0);
 			break;
 		case LINE_INSERT:
-			for (p = HMAP, cnt = sp->t_rows; cnt--; ++p)
-				++p->lno;
+			for (p = HMAP; p <= TMAP; ++p)
+				p->lno += cnt;
 			if (sp->lno >= lno)
-				++sp->lno;
+				sp->lno += cnt;
 			F_SET(vip, VIP_N_RENUMBER);
-			break;
+			return (0);
 		case LINE_RESET:
+			if (cnt <= HMAP->lno - lno)
+				return (0);
+			cnt -= HMAP->lno - lno;
+			lno = HMAP->lno;
 			break;
 		}
-		return (0);
 	}
 
 	F_SET(vip, VIP_N_REFRESH);
 
 	/*
 	 * Invalidate the line size cache, and invalidate the cursor if it's
-	 * on this line,
+	 * on this line, or on one of the deleted lines.
 	 */
 	VI_SCR_CFLUSH(vip);
-	if (sp->lno == lno)
+	if (sp->lno >= lno &&
+	    sp->lno - lno < (op == LINE_INSERT ? 1 : cnt))
 		F_SET(vip, VIP_CUR_INVALID);
 
 	/*
@@ -130,22 +159,27 @@ vs_change(SCR *sp, recno_t lno, lnop_t op)
 
 	switch (op) {
 	case LINE_DELETE:
-		if (vs_sm_delete(sp, lno))
+		if (vs_sm_delete(sp, lno, cnt))
 			return (1);
 		if (sp->lno > lno)
-			--sp->lno;
+			sp->lno = sp->lno - lno < cnt ? lno : sp->lno - cnt;
 		F_SET(vip, VIP_N_RENUMBER);
 		break;
 	case LINE_INSERT:
-		if (vs_sm_insert(sp, lno))
-			return (1);
-		if (sp->lno > lno)
-			++sp->lno;
+		/* Inserted lines past the end of the map are ignored. */
+		for (; cnt > 0 && lno <= TMAP->lno; --cnt, ++lno) {
+			if (vs_sm_insert(sp, lno))
+				return (1);
+			if (sp->lno > lno)
+				++sp->lno;
+		}
 		F_SET(vip, VIP_N_RENUMBER);
 		break;
 	case LINE_RESET:
-		if (vs_sm_reset(sp, lno))
-			return (1);
+		/* Reset lines past the end of the map are ignored. */
+		for (; cnt > 0 && lno <= TMAP->lno; --cnt, ++lno)
+			if (vs_sm_reset(sp, lno))
+				return (1);
 		break;
 	default:
 		abort();
@@ -301,24 +335,24 @@ err:	HMAP->lno = 1;
 
 /*
  * vs_sm_delete --
- *	Delete a line out of the SMAP.
+ *	Delete cnt lines out of the SMAP.
  */
 static int
-vs_sm_delete(SCR *sp, recno_t lno)
+vs_sm_delete(SCR *sp, recno_t lno, recno_t cnt)
 {
 	SMAP *p, *t;
 	size_t cnt_orig;
 
 	/*
 	 * Find the line in the map, and count the number of screen lines
-	 * which display any part of the deleted line.
+	 * which display any part of the deleted lines.
 	 */
 	for (p = HMAP; p->lno != lno; ++p);
 	if (O_ISSET(sp, O_LEFTRIGHT))
-		cnt_orig = 1;
+		cnt_orig = MIN(cnt, (TMAP - p) + 1);
 	else
 		for (cnt_orig = 1, t = p + 1;
-		    t <= TMAP && t->lno == lno; ++cnt_orig, ++t);
+		    t <= TMAP && t->lno - lno < cnt; ++cnt_orig, ++t);
 
 	HANDLE_WEIRDNESS(cnt_orig);
 
@@ -332,7 +366,7 @@ vs_sm_delete(SCR *sp, recno_t lno)
 
 	/* Decrement the line numbers for the rest of the map. */
 	for (t = TMAP - cnt_orig; p <= t; ++p)
-		--p->lno;
+		p->lno -= cnt;
 
 	/* Display the new lines. */
 	for (p = TMAP - cnt_orig;;) {